@@ -0,0 +1,175 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include <string.h>
+#include <algorithm>
+
+#include "AhoCorasick.h"
+#include "Debug.h"
+
+void AhoCorasick::Clear() {
+	mNumClasses = 0;
+	mMaxLength = 0;
+	mDelta.clear();
+	mFirstOutput = 0;
+	mOutputStart.clear();
+	mOutputs.clear();
+	mEmpty.clear();
+}
+
+bool AhoCorasick::Build(const std::vector<std::string> &strings) {
+	Clear();
+	// Every byte that is used gets a class of its own. If all 256 are used, the last one gets class 0.
+	memset(mClass, 0, sizeof mClass);
+	mNumClasses = 1;
+	for (auto &str : strings) {
+		for (unsigned char c : str) {
+			if (mClass[c] == 0 && mNumClasses < 256)
+				mClass[c] = mNumClasses++;
+		}
+	}
+	const uint32_t none = ~uint32_t(0);
+
+	// Build the trie
+	std::vector<uint32_t> delta(mNumClasses, none);
+	std::vector<std::vector<uint32_t>> outputs(1);
+	for (unsigned i = 0; i < strings.size(); i++) {
+		mMaxLength = std::max(mMaxLength, unsigned(strings[i].size()));
+		if (strings[i].empty()) {
+			mEmpty.push_back(i);
+			continue;
+		}
+		uint32_t state = 0;
+		for (unsigned char c : strings[i]) {
+			if (delta[state * mNumClasses + mClass[c]] == none) {
+				delta[state * mNumClasses + mClass[c]] = outputs.size();
+				outputs.emplace_back();
+				delta.resize(delta.size() + mNumClasses, none);
+			}
+			state = delta[state * mNumClasses + mClass[c]];
+		}
+		outputs[state].push_back(i);
+	}
+	unsigned numStates = outputs.size();
+	if (uint64_t(numStates) * mNumClasses > UINT32_MAX) {
+		LPLOG("%u states is too many", numStates);
+		Clear();
+		return false;
+	}
+
+	// Add the fail transitions, breadth first, which makes the trie a complete DFA.
+	std::vector<uint32_t> fail(numStates, 0);
+	std::vector<uint32_t> queue;
+	for (unsigned c = 0; c < mNumClasses; c++) {
+		uint32_t &next = delta[c];
+		if (next == none)
+			next = 0;
+		else
+			queue.push_back(next);
+	}
+	for (size_t i = 0; i < queue.size(); i++) {
+		uint32_t state = queue[i];
+		auto &out = outputs[state];
+		out.insert(out.end(), outputs[fail[state]].begin(), outputs[fail[state]].end());
+		for (unsigned c = 0; c < mNumClasses; c++) {
+			uint32_t &next = delta[state * mNumClasses + c];
+			uint32_t failNext = delta[fail[state] * mNumClasses + c];
+			if (next == none) {
+				next = failNext;
+			} else {
+				fail[next] = failNext;
+				queue.push_back(next);
+			}
+		}
+	}
+
+	// Number the states again, with the states that have output last. The root remains 0.
+	std::vector<uint32_t> number(numStates);
+	uint32_t count = 0;
+	for (int withOutput = 0; withOutput < 2; withOutput++) {
+		if (withOutput)
+			mFirstOutput = count * mNumClasses;
+		for (unsigned state = 0; state < numStates; state++) {
+			if (outputs[state].empty() != bool(withOutput))
+				number[state] = count++;
+		}
+	}
+	mDelta.resize(delta.size());
+	mOutputStart.resize(numStates - mFirstOutput / mNumClasses + 1);
+	for (unsigned state = 0; state < numStates; state++) {
+		for (unsigned c = 0; c < mNumClasses; c++)
+			mDelta[number[state] * mNumClasses + c] = number[delta[state * mNumClasses + c]] * mNumClasses;
+	}
+	for (unsigned state = 0; state < numStates; state++) {
+		if (outputs[state].empty())
+			continue;
+		uint32_t i = number[state] - mFirstOutput / mNumClasses;
+		mOutputStart[i] = mOutputs.size();
+		mOutputs.insert(mOutputs.end(), outputs[state].begin(), outputs[state].end());
+	}
+	// The output states were added in the same order as they were numbered
+	mOutputStart.back() = mOutputs.size();
+	LPLOG("%u strings, %u states, %u classes", (unsigned)strings.size(), numStates, mNumClasses);
+	return true;
+}
+
+void AhoCorasick::Output(uint32_t row, uint64_t *found) const {
+	unsigned i = (row - mFirstOutput) / mNumClasses;
+	for (uint32_t o = mOutputStart[i]; o < mOutputStart[i + 1]; o++)
+		found[mOutputs[o] / 64] |= uint64_t(1) << (mOutputs[o] % 64);
+}
+
+void AhoCorasick::Search(const char *text, size_t size, uint64_t *found) const {
+	for (auto i : mEmpty)
+		found[i / 64] |= uint64_t(1) << (i % 64);
+	const uint32_t *delta = mDelta.data();
+	const unsigned char *p = (const unsigned char *)text;
+	const unsigned char *end = p + size;
+	uint32_t row = 0;
+	if (size >= cMinSplit && size >= 4 * mMaxLength) {
+		// The first half continues into the second, to find strings that cross the middle.
+		size_t half = size / 2;
+		size_t firstSize = half + mMaxLength - 1;
+		size_t both = std::min(firstSize, size - half);
+		const unsigned char *q = p + half;
+		uint32_t row2 = 0;
+		for (size_t i = 0; i < both; i++) {
+			row = delta[row + mClass[p[i]]];
+			row2 = delta[row2 + mClass[q[i]]];
+			if (row >= mFirstOutput)
+				Output(row, found);
+			if (row2 >= mFirstOutput)
+				Output(row2, found);
+		}
+		// Finish the part that is longer
+		if (firstSize > both) {
+			end = p + firstSize;
+			p += both;
+		} else {
+			p = q + both;
+			row = row2;
+		}
+	}
+	for (; p < end; p++) {
+		row = delta[row + mClass[*p]];
+		if (row >= mFirstOutput)
+			Output(row, found);
+	}
+}
+
+size_t AhoCorasick::MemoryUsage() const {
+	return (mDelta.size() + mOutputStart.size() + mOutputs.size()) * sizeof(uint32_t);
+}
@@ -0,0 +1,51 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Find all of a set of strings in a text, in one pass over the text.
+// The automaton is a complete DFA, where the bytes are mapped to classes. Bytes that are not
+// part of any string share one class, which keeps the table small.
+// The time is limited by the latency of the table lookups, which depend on each other. Long
+// texts are therefore searched in two halves at the same time.
+class AhoCorasick
+{
+public:
+	// Return false if there are too many strings, and the automaton can't be used.
+	bool Build(const std::vector<std::string> &strings);
+	void Clear();
+	bool Empty() const { return mDelta.empty(); }
+	// Set bit 'i' in 'found' for every string 'i' that is present in the text. Other bits are not changed.
+	void Search(const char *text, size_t size, uint64_t *found) const;
+	size_t MemoryUsage() const;
+
+private:
+	static const size_t cMinSplit = 64; // Shorter texts are not split in two halves
+	unsigned mNumClasses = 0;
+	uint8_t mClass[256];
+	unsigned mMaxLength = 0;
+	std::vector<uint32_t> mDelta;       // Next state, premultiplied with mNumClasses
+	uint32_t mFirstOutput = 0;          // States where strings end are numbered last, this is the first one, premultiplied
+	std::vector<uint32_t> mOutputStart; // For every state from mFirstOutput, where its strings start in mOutputs
+	std::vector<uint32_t> mOutputs;     // Strings that end at a state, including those of the fail states
+	std::vector<uint32_t> mEmpty;       // Empty strings, always found
+
+	void Output(uint32_t row, uint64_t *found) const;
+};
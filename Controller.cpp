@@ -17,6 +17,9 @@
 #include <stdlib.h>
 #include <gdk/gdkkeysyms.h> // Needed for GTK+-2.0
 #include <string>
+#include <fstream>
+#include <ctime>
+#include <thread>
 
 #include "Controller.h"
 #include "Document.h"
@@ -86,6 +89,8 @@ void Controller::ExecuteCommand(const std::string &name) {
 		mView.SetFocusFind();
 	else if (name == "close")
 		CloseCurrentTab();
+	else if (name == "saveperformance")
+		SavePerformanceReport();
 	else if (name == "paste")
 		TextViewKeyPress(GDK_KEY_Paste);
 	else if (name == "patternstore") {
@@ -100,12 +105,6 @@ void Controller::ExecuteCommand(const std::string &name) {
 		LPLOG("Unknown button: %s", name.c_str());
 }
 
-static gboolean TestForeChanges(Controller *c)
-{
-	c->PollInput();
-	return true; // Keep timer going for ever
-}
-
 static void PatternCellUpdated(GtkCellRenderer *renderer, gchar *path, gchar *newString, Controller *c)
 {
 	c->PatternCellUpdated(renderer, path, newString);
@@ -158,9 +157,17 @@ static void DragDataReceived(GtkWidget *widget, GdkDragContext *context, gint x,
 	}
 	char **str = gtk_selection_data_get_uris(data);
 	bool success = false;
-	LPLOG("%s", str[0]);
 	if (str != nullptr) {
-		c->OpenURI(str[0]); // Only get the first reference for now
+		LPLOG("%s", str[0]);
+		std::vector<std::string> fileNames;
+		for (char **uri = str; *uri != nullptr; uri++) {
+			if (strncmp(*uri, filePrefixURI.c_str(), filePrefixURI.size()) == 0)
+				fileNames.push_back(*uri + filePrefixURI.size());
+		}
+		if (fileNames.size() > 1)
+			c->OpenFiles(fileNames); // Merged into one tab
+		else
+			c->OpenURI(str[0]);
 		g_strfreev(str);
 		success = true;
 	}
@@ -191,8 +198,10 @@ void Controller::Find(const std::string &str) {
 	if (mCurrentDoc == nullptr)
 		return;
 	LPLOG("[%d] '%s'", mView.GetCurrentTabId(), str.c_str());
+	if (str[0] == '@' && mView.JumpToTime(mCurrentDoc, str.substr(1)))
+		return;
 	mCurrentDoc->ResetSearch();
-	mView.FindNext(mCurrentDoc, str, 1);
+	mView.StartSearch(mCurrentDoc, str);
 }
 
 void Controller::CloseCurrentTab() {
@@ -202,8 +211,8 @@ void Controller::CloseCurrentTab() {
 	LPLOG("[%d] tab", id);
 	if (mCurrentDoc == &mDocumentList[id])
 		mCurrentDoc = nullptr;
+	mView.CloseCurrentTab(); // Before the document goes, the view forgets it
 	mDocumentList.erase(id);
-	mView.CloseCurrentTab();
 	mView.SetWindowTitle("");
 	mView.UpdateStatusBar(nullptr);
 }
@@ -211,6 +220,7 @@ void Controller::CloseCurrentTab() {
 void Controller::ChangeDoc(int id) {
 	mCurrentDoc = &mDocumentList[id];
 	LPLOG("[%d] doc (%p), lines %u", id, mCurrentDoc, mCurrentDoc->GetNumLines());
+	mCurrentDoc->RequestUpdate();
 	this->PollInput();
 	mView.SetWindowTitle(mCurrentDoc->GetFileNameShort());
 	mQueueReplace = true;
@@ -225,13 +235,47 @@ void Controller::OpenURI(const std::string &uri) {
 	const std::string filename = uri.substr(prefixSize);
 	mCurrentDoc = &mDocumentList[mView.nextId];
 	LPLOG("[%d] %s new document %p", mView.GetCurrentTabId(), filename.c_str(), mCurrentDoc);
+	this->Configure(mCurrentDoc);
 	mCurrentDoc->AddSourceFile(filename);
 	mView.AddTab(mCurrentDoc, this, G_CALLBACK(::DragDataReceived), G_CALLBACK(::TextViewKeyPress), true);
+	Watch(mCurrentDoc);
+}
+
+void Controller::OpenFiles(const std::vector<std::string> &fileNames) {
+	if (fileNames.size() < 2) {
+		if (!fileNames.empty())
+			this->OpenURI(filePrefixURI + fileNames[0]);
+		return;
+	}
+	mCurrentDoc = &mDocumentList[mView.nextId];
+	LPLOG("[%d] %u files merged in new document %p", mView.GetCurrentTabId(), (unsigned)fileNames.size(), mCurrentDoc);
+	this->Configure(mCurrentDoc);
+	mCurrentDoc->AddSourceFiles(fileNames);
+	mView.AddTab(mCurrentDoc, this, G_CALLBACK(::DragDataReceived), G_CALLBACK(::TextViewKeyPress), true);
+	Watch(mCurrentDoc);
+}
+
+void Controller::Configure(Document *doc) {
+	doc->SetTailFirst(true);
+	doc->SetFollow(mSaveFile.GetIntOption("FollowRotation", 1) != 0);
+	doc->SetRetention(mSaveFile.GetIntOption("MaxLines", 0), uint64_t(mSaveFile.GetIntOption("MaxMegabytes", 0)) * 1024 * 1024);
+	doc->SetTimestamp(Timestamp(mSaveFile.GetStringOption("TimestampFormat", Timestamp::cDefaultFormat)));
+}
+
+void Controller::Watch(Document *doc) {
+	auto changed = [this, doc]() {
+		// Only the current document is updated. Others are updated when they are selected.
+		if (doc != mCurrentDoc)
+			return false;
+		doc->RequestUpdate(); // The result is taken care of in the main loop
+		return doc->TakeActivity();
+	};
+	doc->Watch(changed, mSaveFile.GetIntOption("PollPeriod", 1000));
 }
 
-void Controller::PollInput() {
+bool Controller::PollInput() {
 	if (mCurrentDoc == nullptr)
-		return; // There is no current document
+		return false; // There is no current document
 	Document::UpdateResult res = mCurrentDoc->UpdateInputData();
 	switch (res) {
 	case Document::UpdateResult::Replaced: {
@@ -240,16 +284,24 @@ void Controller::PollInput() {
 		std::string fn = mCurrentDoc->GetFileName();
 		Document *newDoc = &mDocumentList[mView.nextId]; // Restarted new file
 		LPLOG("[%d] new document %p for %s", mView.GetCurrentTabId(), newDoc, fn.c_str());
+		this->Configure(newDoc);
 		newDoc->AddSourceFile(fn);
 		mView.AddTab(newDoc, this, G_CALLBACK(::DragDataReceived), G_CALLBACK(::TextViewKeyPress), true);
+		Watch(newDoc);
 		break;
 	}
 	case Document::UpdateResult::Grow:
 		mQueueAppend = true;
 		break;
+	case Document::UpdateResult::Prepended:
+	case Document::UpdateResult::Changed: // The same lines, but all have to be filtered again
+		mView.Prepend(mCurrentDoc);
+		mView.UpdateStatusBar(mCurrentDoc);
+		break;
 	case Document::UpdateResult::NoChange:
 		break;
 	}
+	return res != Document::UpdateResult::NoChange;
 }
 
 void Controller::TogglePattern(GtkCellRendererToggle *renderer, gchar *path) {
@@ -276,7 +328,7 @@ void Controller::ToggleButton(const std::string &name) {
 		mView.FindSetCaseSensitive();
 		if (mCurrentDoc) {
 			mCurrentDoc->ResetSearch();
-			mView.FindNext(mCurrentDoc, mView.GetSearchString(), 1);
+			mView.StartSearch(mCurrentDoc, mView.GetSearchString());
 		}
 	} else if (name == "ignoreduplicates") {
 		mView.ToggleIgnoreDuplicateLines();
@@ -287,6 +339,8 @@ void Controller::ToggleButton(const std::string &name) {
 		mView.FindNext(mCurrentDoc, mView.GetSearchString(), -1);
 	else if (name == "linenumbers")
 		mView.ToggleLineNumbers(mCurrentDoc);
+	else if (name == "performance")
+		mView.TogglePerformance(mCurrentDoc);
 	else
 		LPLOG("[%d] unknown %s", mView.GetCurrentTabId(), name.c_str());
 }
@@ -372,24 +426,38 @@ void Controller::Run(int argc, char *argv[], GdkPixbuf *icon) {
 	mView.Create(icon, G_CALLBACK(::ButtonClicked), G_CALLBACK(::ToggleButton), G_CALLBACK(::TreeViewKeyPressed), G_CALLBACK(::KeyPressedOther), G_CALLBACK(::PatternCellUpdated),
 				 G_CALLBACK(::TogglePattern), G_CALLBACK(::ChangeCurrentPage), G_CALLBACK(::DestroyMainWindow), G_CALLBACK(::EditEntry), this);
 	mView.SetWindowTitle("");
-	if (argc > 1) {
-		this->OpenURI(filePrefixURI + argv[1]);
+	if (argc > 2) {
+		this->OpenFiles(std::vector<std::string>(argv + 1, argv + argc));
+	} else if (argc > 1) {
+		this->OpenFiles(Document::MatchFileNames(argv[1])); // A pattern in quotes, e.g. "logs/*.log"
 	}
 	mView.DeSerialize(mSaveFile);
-	g_timeout_add(mSaveFile.GetIntOption("PollPeriod", 1000), GSourceFunc(::TestForeChanges), this);
 	while (!mQuitNow) {
 		gtk_main_iteration();
-		if (mQueueReplace && mCurrentDoc != nullptr) {
+		this->PollInput(); // Lines read by the worker thread of the current document
+		if (mCurrentDoc == nullptr) {
+			mQueueAppend = false;
+		} else if (mQueueReplace) {
 			LPLOG("[%d] queued replace", mView.GetCurrentTabId());
 			mView.Replace(mCurrentDoc);
 			mView.UpdateStatusBar(mCurrentDoc);
-		} else if (mQueueAppend && mCurrentDoc != nullptr) {
-			LPLOG("[%d] queued append", mView.GetCurrentTabId());
-			mView.Append(mCurrentDoc);
-			mView.UpdateStatusBar(mCurrentDoc);
+			mQueueAppend = false;
+		} else if (mQueueAppend) {
+			// When lines come in fast, they are collected and appended once per frame
+			if (mView.TakeFrame()) {
+				LPTRACE("[%d] queued append", mView.GetCurrentTabId());
+				mView.Append(mCurrentDoc);
+				mView.UpdateStatusBar(mCurrentDoc);
+				mQueueAppend = false;
+			} else {
+				mView.RequestFrame();
+			}
+		} else {
+			mView.UpdateRate(mCurrentDoc);
 		}
-		mQueueAppend = false;
 		mQueueReplace = false;
+		if (mView.SearchStep(mCurrentDoc))
+			g_main_context_wakeup(nullptr); // Continue in the next iteration, after events are handled
 	}
 	SaveCurrentPattern();
 }
@@ -412,12 +480,35 @@ void Controller::Help() const {
 	mView.Help(msg);
 }
 
+// All tabs, to be attached when a performance problem is reported
+void Controller::SavePerformanceReport() {
+	GtkWidget *dialog = mView.FileSaveDialog("lplog-performance.txt");
+	if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT) {
+		char *filename = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
+		std::time_t now = std::time(nullptr);
+		char date[100];
+		std::strftime(date, sizeof date, "%c", std::localtime(&now));
+		std::ofstream output(filename);
+		output << "lplog performance report " << date << ", " << std::thread::hardware_concurrency() << " cores\n\n";
+		for (auto &doc : mDocumentList)
+			output << doc.second.PerformanceReport() << "\n";
+		if (!output)
+			mView.Help(std::string("Failed to write ") + filename);
+		LPLOG("%s", filename);
+		g_free(filename);
+	}
+	gtk_widget_destroy(dialog);
+}
+
 void Controller::FileOpenDialog() {
 	GtkWidget *dialog = mView.FileOpenDialog();
 	if (gtk_dialog_run (GTK_DIALOG (dialog)) == GTK_RESPONSE_ACCEPT) {
-		char *filename = gtk_file_chooser_get_filename (GTK_FILE_CHOOSER (dialog));
-		this->OpenURI(filePrefixURI + filename);
-		g_free(filename);
+		GSList *filenames = gtk_file_chooser_get_filenames(GTK_FILE_CHOOSER(dialog));
+		std::vector<std::string> fileNames;
+		for (GSList *p = filenames; p != nullptr; p = p->next)
+			fileNames.push_back((const char *)p->data);
+		g_slist_free_full(filenames, g_free);
+		this->OpenFiles(fileNames);
 	}
 	gtk_widget_destroy(dialog);
 }
@@ -35,10 +35,11 @@ public:
 
 	void Run(int argc, char *argv[], GdkPixbuf *icon);
 	void OpenURI(const std::string &uri);
+	void OpenFiles(const std::vector<std::string> &fileNames); // More than one file are merged into one tab
 	void PatternCellUpdated(GtkCellRenderer *renderer, gchar *path, gchar *newString);
 	void TogglePattern(GtkCellRendererToggle *renderer, gchar *path);
 	void ToggleButton(const std::string &name);                              // Click toggle button and other buttons
-	void PollInput();
+	bool PollInput();                                                        // Return true if there was a change
 	void ChangeDoc(int id);                                                  // Change current document
 	void Quit() { mQuitNow = true; }                                         // Request application to shut down
 	void Find(const std::string &);
@@ -50,6 +51,9 @@ private:
 	void Help() const;
 	gboolean KeyPressed(guint keyval);
 	void SaveCurrentPattern(); // Save it to mSaveFile
+	void Watch(Document *);    // Start following changes of the source file
+	void Configure(Document *); // Set the options of a new document, before the file is added
+	void SavePerformanceReport();
 
 	bool mValidSelectedPatternIter = false;
 	View mView;
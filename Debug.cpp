@@ -13,21 +13,168 @@
 // along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
 //
 
+
 #include <cstdarg>
 #include <cstdio>
-#include <gtk/gtk.h>
 #include <ctime>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <algorithm>
 
 #include "Debug.h"
+#include "SpscQueue.h"
+
+namespace {
+
+struct Record {
+	std::chrono::steady_clock::time_point time;
+	const char *func;
+	const char *file;
+	int line;
+	unsigned thread;
+	char text[200]; // Longer messages are truncated
+};
+
+// The messages of one thread, waiting for the background thread
+struct Ring {
+	Ring();
+	~Ring();
+	unsigned thread;
+	SpscQueue<Record, 1024> records;
+	std::atomic<unsigned> dropped{0};
+};
+
+class Tracer
+{
+public:
+	static Tracer &Get();
+	~Tracer();
+	unsigned Add(Ring *); // Return a number for the thread
+	void Remove(Ring *);  // The thread ends, take care of what is left in the ring
+
+private:
+	Tracer();
+	static const unsigned cWritePeriod = 5; // ms
+	std::mutex mMutex;                       // Protects the following, and taking records from the rings
+	std::vector<Ring *> mRings;
+	std::vector<Record> mLeft;               // Records of threads that have ended
+	unsigned mNumThreads = 0;
+
+	std::atomic<bool> mQuit{false};
+	std::thread mWriter;
+	// The wall clock time that corresponds to a monotonic time
+	std::chrono::steady_clock::time_point mStart;
+	std::chrono::system_clock::time_point mStartTime;
+
+	static void Take(Ring *, std::vector<Record> &);
+	void Writer();
+	void Flush(); // Write all messages so far
+};
+
+Ring::Ring() {
+	thread = Tracer::Get().Add(this);
+}
+
+Ring::~Ring() {
+	Tracer::Get().Remove(this);
+}
+
+Tracer &Tracer::Get() {
+	static Tracer tracer;
+	return tracer;
+}
+
+Tracer::Tracer() : mStart(std::chrono::steady_clock::now()), mStartTime(std::chrono::system_clock::now()) {
+	mWriter = std::thread(&Tracer::Writer, this);
+}
+
+Tracer::~Tracer() {
+	mQuit = true;
+	mWriter.join();
+	this->Flush();
+}
+
+unsigned Tracer::Add(Ring *ring) {
+	std::lock_guard<std::mutex> lock(mMutex);
+	mRings.push_back(ring);
+	return mNumThreads++;
+}
+
+void Tracer::Remove(Ring *ring) {
+	std::lock_guard<std::mutex> lock(mMutex);
+	Take(ring, mLeft);
+	mRings.erase(std::find(mRings.begin(), mRings.end(), ring));
+}
+
+// Has to be called with mMutex locked, as only one thread at a time may take from a ring
+void Tracer::Take(Ring *ring, std::vector<Record> &records) {
+	Record record;
+	while (ring->records.Pop(record))
+		records.push_back(record);
+	unsigned dropped = ring->dropped.exchange(0);
+	if (dropped > 0) {
+		record.time = std::chrono::steady_clock::now(); // The record left by Pop is an old message, or not set at all
+		record.line = 0; // No source location
+		record.thread = ring->thread;
+		std::snprintf(record.text, sizeof record.text, "%u messages dropped", dropped);
+		records.push_back(record);
+	}
+}
+
+void Tracer::Writer() {
+	while (!mQuit) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(cWritePeriod));
+		this->Flush();
+	}
+}
+
+void Tracer::Flush() {
+	std::vector<Record> records;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		records.swap(mLeft);
+		for (auto ring : mRings)
+			Take(ring, records);
+	}
+	if (records.empty())
+		return;
+	// Every thread is in order, but the threads have to be merged
+	std::stable_sort(records.begin(), records.end(), [](const Record &a, const Record &b) { return a.time < b.time; });
+	std::time_t second = 0;
+	char date[30] = "";
+	for (auto &record : records) {
+		auto time = mStartTime + std::chrono::duration_cast<std::chrono::system_clock::duration>(record.time - mStart);
+		std::time_t t = std::chrono::system_clock::to_time_t(time);
+		if (t != second) {
+			second = t;
+			std::strftime(date, sizeof date, "%H:%M:%S", std::localtime(&t));
+		}
+		auto us = std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count() % 1000000;
+		if (record.line == 0)
+			std::printf("%s.%06u [%u] %s\n", date, unsigned(us), record.thread, record.text);
+		else
+			std::printf("%s.%06u [%u] %s:%s:%d %s\n", date, unsigned(us), record.thread, record.file, record.func, record.line, record.text);
+	}
+	std::fflush(stdout);
+}
+
+} // namespace
 
 void LPLog(const char *func, const char *file, int line, const char *fmt, ...) {
-	std::time_t result = std::time(NULL);
-	char buff[30];
-	std::strftime(buff, sizeof buff, "%c", std::localtime(&result));
-	std::printf("%s %s:%s:%d ", buff, file, func, line);
+	static thread_local Ring ring;
+	Record record;
+	record.time = std::chrono::steady_clock::now();
+	record.func = func;
+	record.file = file;
+	record.line = line;
+	record.thread = ring.thread;
 	std::va_list args;
 	va_start(args, fmt);
-	std::vprintf(fmt, args);
-	std::printf("\n");
-	std::fflush(stdout);
+	std::vsnprintf(record.text, sizeof record.text, fmt, args);
+	va_end(args);
+	if (!ring.records.Push(std::move(record)))
+		ring.dropped++;
 }
@@ -13,11 +13,29 @@
 // along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
 //
 
+
 #pragma once
 
+// Messages for debugging, which are only compiled in DEBUG builds.
+// LPLOG is for events, and LPTRACE for what happens all the time, e.g. for every batch of lines or every poll.
+// LPTRACE is only compiled with LPLOG_LEVEL 2 or more, e.g. "make CXXFLAGS='-g -DDEBUG -DLPLOG_LEVEL=2'".
+// The caller only formats the message into a ring buffer of its own thread, without locks. Time stamps,
+// file names and the output are taken care of by a background thread. If the buffer is full, the message
+// is dropped instead of waiting, and the number of dropped messages is shown.
+
+#ifndef LPLOG_LEVEL
+#define LPLOG_LEVEL 1
+#endif
+
 #ifdef DEBUG
 extern void LPLog(const char *func, const char *file, int line, const char *fmt, ...);
 #define LPLOG(...) LPLog(__FUNCTION__, __FILE__, __LINE__, __VA_ARGS__)
 #else
 #define LPLOG(...)
 #endif
+
+#if defined(DEBUG) && LPLOG_LEVEL >= 2
+#define LPTRACE(...) LPLog(__FUNCTION__, __FILE__, __LINE__, __VA_ARGS__)
+#else
+#define LPTRACE(...)
+#endif
@@ -15,6 +15,10 @@
 #undef __STRICT_ANSI__ // Needed for "struct stat" in MinGW.
 
 #include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <queue>
+#include <sstream>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/time.h>
@@ -22,47 +26,43 @@
 
 #ifndef _WIN32
 #include <unistd.h>
+#include <sys/mman.h>
 #endif
 
 #include "Document.h"
+#include "ThreadPool.h"
+#include "Filter.h"
+#include "Finder.h"
+#include "LineSplitter.h"
 #include "Defer.h"
 #include "Debug.h"
 
-static bool findNL(const char *source, unsigned *length, const char **next) {
-	const char *p = source;
-	for (; *p != 0; ++p) {
-		if (p[0] == '\r' && p[1] == '\n') {
-			// Windows format
-			*next = p+2;
-			*length = p-source;
-			return true;
-		}
-		if (p[0] == '\n' && p[1] == '\r') {
-			// Mac format
-			*next = p+2;
-			*length = p-source;
-			return true;
-		}
-		if (p[0] == '\n') {
-			// Unix format
-			*next = p+1;
-			*length = p-source;
-			return true;
+Document::Batch::~Batch() {
+#ifndef _WIN32
+	if (fd != -1)
+		close(fd);
+#endif
+}
+
+Document::~Document() {
+	if (mWorker.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(mWakeMutex);
+			mQuit = true;
 		}
+		mWake.notify_one();
+		mWorker.join();
 	}
-	if (p == source)
-		return false;
-	// Just a 0-byte terminator
-	*next = p; // Will fail next time
-	*length = p-source;
-	return true;
+	if (mFollowed != nullptr)
+		std::fclose(mFollowed);
 }
 
 std::string Document::Date() const {
 	int ret;
 	char buf[100];
 
-	std::tm *tm = std::localtime(&mFileTime);
+	std::time_t fileTime = mFileTime;
+	std::tm *tm = std::localtime(&fileTime);
 	ret = std::strftime(buf, sizeof buf, "%c", tm);
 	if (ret == 0)
 		return "";
@@ -72,9 +72,20 @@ std::string Document::Date() const {
 
 void Document::StopUpdate() {
 	mStopUpdates = true;
+	mWatcher.Stop();
+	for (auto &source : mSources)
+		source.doc->StopUpdate();
+}
+
+void Document::Watch(FileWatcher::Callback cb, unsigned maxPollPeriod) {
+	if (!this->Merged())
+		mWatcher.Start(mFileName, cb, maxPollPeriod);
+	for (auto &source : mSources)
+		source.doc->Watch(cb, maxPollPeriod);
 }
 
 void Document::AddSourceFile(const std::string &fileName) {
+	g_assert(!mWorker.joinable()); // Only one source file for each document
 	mFileName = fileName;
 #ifdef _WIN32
 	// Change name path /C:/xx into C:/xx, but do not change //server/xx
@@ -83,22 +94,50 @@ void Document::AddSourceFile(const std::string &fileName) {
 #endif
 	mStopUpdates = false;
 	mCurrentPosition = 0;
-	mLines.clear();
+	mLines.Clear();
+	mTimes.Clear();
 	struct stat st = { 0 };
 	if (stat(mFileName.c_str(), &st) == 0) {
 		LPLOG("%s, size %u", mFileName.c_str(), (unsigned)st.st_size);
 	} else {
 		LPLOG("failed to open '%s' (err %d)", mFileName.c_str(), errno);
 	}
+	mWorker = std::thread(&Document::WorkerThread, this);
+	this->RequestUpdate(); // Initial load
+}
+
+void Document::AddSourceFiles(const std::vector<std::string> &fileNames) {
+	g_assert(!mWorker.joinable() && mSources.empty()); // There is no worker, the documents of the files have them
+	mLines.Clear();
+	mTimes.Clear();
+	for (auto &fileName : fileNames) {
+		mSourceDocs.emplace_back();
+		Document &doc = mSourceDocs.back();
+		doc.SetFollow(mFollow);
+		doc.SetTimestamp(mTimestamp);
+		doc.AddSourceFile(fileName);
+		Source source;
+		source.doc = &doc;
+		source.name = doc.GetFileNameShort();
+		source.next = 0;
+		source.evicted = 0;
+		mSources.push_back(source);
+		mSourceNameSize = std::max(mSourceNameSize, unsigned(source.name.size()));
+		mFileName += (mFileName.empty() ? "" : " + ") + source.name;
+	}
+	LPLOG("%u files merged, time stamps '%s'", (unsigned)mSources.size(), mTimestamp.Format().c_str());
 }
 
 void Document::AddSourceText(char *text, unsigned size) {
 	mStopUpdates = true;
 	mFileName = "[Paste]";
 	mCurrentPosition = 0;
-	mLines.clear();
+	mLines.Clear();
+	mTimes.Clear();
 	DetectFileType((const unsigned char *)text, size);
-	this->SplitLines(text, size);
+	Batch batch;
+	this->SplitLines(text, size, cNotMapped, batch);
+	this->Apply(batch);
 	LPLOG("%d characters %u lines", size, (unsigned)mLines.size());
 	mFileTime = std::time(nullptr);
 }
@@ -138,26 +177,117 @@ void Document::DetectFileType(const unsigned char *p, unsigned size) {
 	LPLOG("ASCII");
 }
 
-Document::UpdateResult Document::UpdateInputData() {
-	mFirstNewLine = mLines.size(); // Remember where the new lines started after the update
+void Document::RequestUpdate() {
+	for (auto &source : mSources)
+		source.doc->RequestUpdate();
+	if (!mWorker.joinable() || mStopUpdates)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(mWakeMutex);
+		mUpdateRequested = true;
+	}
+	mWake.notify_one();
+}
+
+bool Document::Loading() {
+	for (auto &source : mSources) {
+		if (source.doc->Loading())
+			return true;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mWakeMutex);
+		if (mUpdateRequested || mReading)
+			return true;
+	}
+	// The worker pushes all batches before it stops reading
+	return !mBatches.Empty();
+}
+
+bool Document::TakeActivity() {
+	bool activity = mActivity.exchange(false);
+	for (auto &source : mSources)
+		activity = source.doc->TakeActivity() || activity;
+	return activity;
+}
+
+void Document::WorkerThread() {
+	std::unique_lock<std::mutex> lock(mWakeMutex);
+	for (;;) {
+		mWake.wait(lock, [this]() { return mQuit || mUpdateRequested; });
+		if (mQuit)
+			return;
+		mUpdateRequested = false;
+		mReading = true;
+		lock.unlock();
+		this->ReadInput();
+		bool head = mHeadEnd > 0;
+		bool more = this->ReadHead();
+		lock.lock();
+		mReading = false;
+		if (more)
+			mUpdateRequested = true; // Continue with the start of the file, after the end is checked for new lines
+		else if (head && mFollowed != nullptr)
+			mUpdateRequested = true; // A rotated file waits for the start of the old one
+	}
+}
+
+// Hand over a batch to the main thread, waiting if the queue is full.
+void Document::Push(std::unique_ptr<Batch> batch) {
+	mActivity = true;
+	while (!mBatches.Push(std::move(batch))) {
+		{
+			std::lock_guard<std::mutex> lock(mWakeMutex);
+			if (mQuit)
+				return;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	}
+	g_main_context_wakeup(nullptr); // Have the main loop take care of it
+}
+
+// Executed by the worker thread.
+void Document::ReadInput() {
 	if (mFileName == "" || mStopUpdates)
-		return UpdateResult::NoChange;
+		return;
 
 	// Update the time stamp of the file to latest
 	struct stat st = { 0 };
-	if (stat(mFileName.c_str(), &st) != 0)
-		return UpdateResult::NoChange; // We don't know, the file couldn't be access just now.
+	if (stat(mFileName.c_str(), &st) != 0) {
+		this->ReadFollowed(); // It may have been renamed, before a new file is created
+		return; // We don't know, the file couldn't be access just now.
+	}
+#ifndef _WIN32
+	struct stat followed = { 0 };
+	if (mFollowed != nullptr && fstat(fileno(mFollowed), &followed) == 0 &&
+		(followed.st_dev != st.st_dev || followed.st_ino != st.st_ino)) {
+		// The file was rotated. The rest of the old file comes before the lines of the new one.
+		this->ReadFollowed();
+		if (mHeadEnd > 0)
+			return; // The start of the old file isn't read yet
+		std::fclose(mFollowed);
+		mFollowed = nullptr;
+		this->StartAgain(false);
+	}
+#endif
 
-	std::FILE *input = std::fopen(mFileName.c_str(), "rb");
-	Defer close([input]() { if (input != nullptr) std::fclose(input);});
+	std::FILE *input = mFollowed != nullptr ? mFollowed : std::fopen(mFileName.c_str(), "rb");
+	Defer close([this, input]() { if (input != nullptr && input != mFollowed) std::fclose(input);});
+#ifndef _WIN32
+	if (mFollow && mFollowed == nullptr && input != nullptr) {
+		mFollowed = input;
+		fstat(fileno(input), &st); // The file opened, if it was replaced after stat()
+	}
+#endif
+	std::unique_ptr<Batch> replaced(new Batch);
+	replaced->result = UpdateResult::Replaced;
 	if (input == nullptr) {
 		// There is no file
 		if (mCurrentPosition != 0) {
 			LPLOG("file unreadable");
 			mStopUpdates = true;
-			return UpdateResult::Replaced;
+			this->Push(std::move(replaced));
 		}
-		return UpdateResult::NoChange;
+		return;
 	}
 
 	bool firstTime = (mFileTime == 0);
@@ -165,125 +295,818 @@ Document::UpdateResult Document::UpdateInputData() {
 	bool documentIsModified = (st.st_mtime != mFileTime || mFileSize != st.st_size);
 	mFileSize = st.st_size;
 	if (!documentIsModified) {
-		// LPLOG("not modified"); // Too verbose for normal debugging
-		return UpdateResult::NoChange; // The usual case for a document that wasn't changed
+		LPTRACE("not modified");
+		return; // The usual case for a document that wasn't changed
 	}
 	mFileTime = st.st_mtime;
 
 	if (!firstTime && documentIsModified && (st.st_size < mCurrentPosition || !EqualToTestBuffer(input, st.st_size))) {
-		// There is a replaced file
-		LPLOG("new content");
-		mStopUpdates = true;
-		return UpdateResult::Replaced;
+		mShrunk = true; // The main thread cuts the lines that are gone
+		if (mFollowed != nullptr && mHeadEnd == 0) {
+			this->StartAgain(true);
+		} else {
+			// There is a replaced file
+			LPLOG("new content");
+			mStopUpdates = true;
+			this->Push(std::move(replaced));
+			return;
+		}
 	}
 
 	if (mCurrentPosition == st.st_size) {
-		LPLOG("same size [%s] [%s]", firstTime?"first":"notfirst",
+		LPTRACE("same size [%s] [%s]", firstTime?"first":"notfirst",
 			documentIsModified?"modifed":"notmodifed");
-		return UpdateResult::NoChange;
+		return;
 	}
 
 	if (documentIsModified && mTestBufferCurrentSize < sizeof mTestBuffer) {
 		bool ok = CopyToTestBuffer(input, st.st_size);
 		if (!ok)
-			return UpdateResult::NoChange; // Give it up for now, try again later
+			return; // Give it up for now, try again later
 		DetectFileType((const unsigned char *)mTestBuffer, mTestBufferCurrentSize);
 	}
-	auto addedSize = st.st_size - mCurrentPosition;
-	char *buff = new char[addedSize+1]; // Reserve space for null byte. Heap allocation needed, as it may be too big for stack.
-	Defer b([buff](){ delete[]buff;});
+	bool mapped = false;
+#ifndef _WIN32
+	// Lines that need no change will refer directly to the file, which the main thread maps.
+	mapped = (mInputType == InputType::Ascii && !mCopyLines);
+#endif
+	bool retention = mMaxLines > 0 || mMaxBytes > 0;
+	if (retention)
+		mUseIndex = false; // The index would keep all lines, also those evicted
+	bool indexed = mapped && mUseIndex;
+	if (indexed && firstTime)
+		this->LoadIndex(input, st);
+#ifndef _WIN32
+	if (mapped && mTailFirst && !retention && firstTime && mCurrentPosition == 0 && st.st_size >= long(cTailFirstSize)) {
+		uint64_t start = this->FindTailStart(fileno(input), st.st_size);
+		if (start > 0) {
+			LPLOG("%llu bytes at the start are read later", (unsigned long long)start);
+			mHeadEnd = start;
+			mCurrentPosition = start;
+			mHeadMissing = true;
+		}
+	}
+#endif
+	this->ReadFile(input, st.st_size, mapped);
+	if (indexed && mCurrentPosition == st.st_size)
+		this->SaveIndex(st);
+}
+
+void Document::ReadFile(std::FILE *input, long fileSize, bool mapped) {
+	std::unique_ptr<char[]> buff(new char[cReadChunkSize]);
 	std::fseek(input, mCurrentPosition, SEEK_SET);
-	unsigned n = (unsigned)std::fread(buff, 1, addedSize, input);
-	LPLOG("start %u size %u, got %u", (unsigned)mCurrentPosition, (unsigned)addedSize, n);
-	mCurrentPosition += n;
-	this->SplitLines(buff, n);
-	this->RemoveColorEscapeSequences();
-	return UpdateResult::Grow;
+	while (mCurrentPosition < fileSize && !mStopUpdates) {
+		auto size = std::min(long(cReadChunkSize), fileSize - mCurrentPosition);
+		unsigned n;
+		{
+			Metrics::Scope scope(mMetrics, Metrics::Timer::Read);
+			n = (unsigned)std::fread(buff.get(), 1, size, input);
+		}
+		mMetrics.AddBytes(n);
+		LPTRACE("start %u size %u, got %u", (unsigned)mCurrentPosition, (unsigned)size, n);
+		if (n == 0)
+			break;
+		std::unique_ptr<Batch> batch(new Batch);
+		this->SplitLines(buff.get(), n, mapped ? mCurrentPosition : cNotMapped, *batch);
+		mCurrentPosition += n;
+#ifndef _WIN32
+		if (mapped) {
+			batch->fd = dup(fileno(input));
+			batch->mapSize = mCurrentPosition;
+		}
+#endif
+		this->Push(std::move(batch));
+	}
+}
+
+void Document::ReadFollowed() {
+#ifndef _WIN32
+	struct stat st = { 0 };
+	if (mFollowed == nullptr || fstat(fileno(mFollowed), &st) != 0)
+		return;
+	this->ReadFile(mFollowed, st.st_size, mInputType == InputType::Ascii && !mCopyLines);
+#endif
+}
+
+// The lines already read are kept, and the lines of the file are added after them. The file is tested and indexed
+// as if it was opened for the first time. A file truncated in place, e.g. by "copytruncate" of logrotate, loses the
+// content that the lines refer to. It will probably be truncated again, which is why the lines are copied from then on.
+void Document::StartAgain(bool truncated) {
+	LPLOG("file %s, continue from the start", truncated ? "truncated" : "rotated");
+	std::unique_ptr<Batch> batch(new Batch);
+	batch->detach = true;
+	batch->truncated = truncated;
+	if (truncated)
+		mCopyLines = true;
+	if (!mIncompleteLastLine.empty())
+		this->AddLine("", 0, true, cNotMapped, *batch); // The last line will get no more characters
+	this->Push(std::move(batch));
+	mCurrentPosition = 0;
+	mFileSize = -1;
+	mTestBufferCurrentSize = 0;
+	mIndex.Clear();
+	mIndexSaved = 0;
+}
+
+void Document::SaveIndex(const struct stat &st) {
+	// The index can't be used if there was a zero byte, and is not complete until the start of the file is read
+	if (!mUseIndex || mHeadEnd > 0 || mIndex.Position() < mIndexSaved + cIndexSaveInterval)
+		return;
+	mIndex.Save(mFileName, this->GetFingerprint(st));
+	mIndexSaved = mIndex.Position();
 }
 
-void Document::IterateLines(std::function<bool (std::string&, unsigned)> f, bool restartFirstLine) {
+// Find where the last cTailLines lines start, but not further back than cMaxTailSize. Return 0 for the start of the file.
+uint64_t Document::FindTailStart(int fd, uint64_t size) {
+	uint64_t start = 0;
+#ifndef _WIN32
+	char buff[64*1024];
+	unsigned newlines = 0;
+	char next = 0; // The character after the one tested
+	for (uint64_t pos = size; pos > 0 && size - pos < cMaxTailSize; ) {
+		unsigned n = unsigned(std::min<uint64_t>(sizeof buff, pos));
+		pos -= n;
+		if (pread(fd, buff, n, pos) != ssize_t(n))
+			return 0;
+		for (unsigned i = n; i-- > 0; next = buff[i]) {
+			// The last newline doesn't start a line, and a Mac newline is "\n\r"
+			if (buff[i] != '\n' || pos + i + 1 == size || next == '\r')
+				continue;
+			start = pos + i + 1;
+			if (++newlines == cTailLines)
+				return start;
+		}
+	}
+#endif
+	return start;
+}
+
+// The lines of the start of the file are split the same way as other lines, but with a state of their own
+void Document::SwapHead() {
+	std::swap(mIncompleteLastLine, mHeadIncompleteLine);
+	std::swap(mIncompleteLineOffset, mHeadIncompleteOffset);
+	std::swap(mIndex, mHeadIndex);
+}
+
+// Find it the same way as FindTailStart(), looking back from 'pos'. Return 0 if there is no newline before.
+uint64_t Document::FindLineStart(int fd, uint64_t pos) {
+#ifndef _WIN32
+	char buff[64*1024];
+	char next = 0; // The character after the one tested
+	for (uint64_t end = pos + 1; end > 0; ) {
+		unsigned n = unsigned(std::min<uint64_t>(sizeof buff, end));
+		end -= n;
+		if (pread(fd, buff, n, end) != ssize_t(n))
+			return 0;
+		for (unsigned i = n; i-- > 0; next = buff[i]) {
+			if (buff[i] == '\n' && end + i < pos && next != '\r')
+				return end + i + 1;
+		}
+	}
+#endif
+	return 0;
+}
+
+// Executed by the worker thread.
+bool Document::ReadHead() {
+#ifndef _WIN32
+	if (mHeadEnd == 0)
+		return false;
+	if (mStopUpdates) {
+		mHeadEnd = 0;
+		return false;
+	}
+	// When the file is followed, the start is read from the same file as the end, even if it was renamed
+	std::FILE *input = mFollowed != nullptr ? mFollowed : std::fopen(mFileName.c_str(), "rb");
+	if (input == nullptr)
+		return false;
+	Defer close([this, input]() { if (input != mFollowed) std::fclose(input); });
+	// The part starts with a line, and ends where the part read before starts
+	uint64_t start = mHeadEnd > cHeadPartSize ? this->FindLineStart(fileno(input), mHeadEnd - cHeadPartSize) : 0;
+	std::unique_ptr<Batch> batch(new Batch);
+	batch->result = UpdateResult::Prepended;
+	batch->fileStart = start == 0;
+	std::unique_ptr<char[]> buff(new char[cReadChunkSize]);
+	std::fseek(input, start, SEEK_SET);
+	this->SwapHead();
+	uint64_t pos = start;
+	while (pos < mHeadEnd) {
+		auto size = std::min(uint64_t(cReadChunkSize), mHeadEnd - pos);
+		unsigned n;
+		{
+			Metrics::Scope scope(mMetrics, Metrics::Timer::Read);
+			n = (unsigned)std::fread(buff.get(), 1, size, input);
+		}
+		mMetrics.AddBytes(n);
+		if (n == 0)
+			break;
+		this->SplitLines(buff.get(), n, pos, *batch);
+		pos += n;
+	}
+	if (!mIncompleteLastLine.empty())
+		LPLOG("no newline at the end of the part at %llu", (unsigned long long)start);
+	this->SwapHead();
+	if (pos < mHeadEnd) {
+		// The part is read again the next time
+		mHeadIndex.Clear();
+		mHeadIncompleteLine.clear();
+		return !std::feof(input) && !std::ferror(input);
+	}
+	LPLOG("%u lines at %llu", (unsigned)batch->lines.size(), (unsigned long long)start);
+	mHeadEnd = start;
+	mHeadIndexes.push_back(std::move(mHeadIndex));
+	mHeadIndex.Clear();
+	batch->fd = dup(fileno(input));
+	batch->mapSize = mCurrentPosition;
+	this->Push(std::move(batch));
+	if (mHeadEnd > 0)
+		return true;
+	// The lines at the start of the file are done, and their index goes before the others
+	LineIndex index;
+	for (auto it = mHeadIndexes.rbegin(); it != mHeadIndexes.rend(); ++it)
+		index.Append(*it);
+	index.Append(mIndex);
+	std::swap(mIndex, index);
+	mHeadIndexes.clear();
+	struct stat st = { 0 };
+	if (fstat(fileno(input), &st) == 0)
+		this->SaveIndex(st);
+#endif
+	return false;
+}
+
+LineIndex::Fingerprint Document::GetFingerprint(const struct stat &st) const {
+	LineIndex::Fingerprint fingerprint;
+	fingerprint.device = st.st_dev;
+	fingerprint.inode = st.st_ino;
+	fingerprint.testSize = mTestBufferCurrentSize;
+	fingerprint.testHash = LineIndex::Hash(mTestBuffer, mTestBufferCurrentSize);
+	return fingerprint;
+}
+
+// Use the index saved the last time the file was read, if it is still valid. Only the rest of the file
+// then has to be read. Lines that were changed are read and changed again.
+void Document::LoadIndex(std::FILE *input, const struct stat &st) {
+#ifndef _WIN32
+	if (!mIndex.Load(mFileName, this->GetFingerprint(st)) || mIndex.Position() > uint64_t(st.st_size)) {
+		mIndex.Clear();
+		return;
+	}
+	int fd = fileno(input);
+	// The file is expected to have a newline at every checkpoint, or the content was changed
+	for (uint64_t pos : mIndex.Checkpoints()) {
+		char c = 0;
+		if (pread(fd, &c, 1, pos) != 1 || (c != '\n' && c != '\r')) {
+			LPLOG("no newline at %llu, the index is not used", (unsigned long long)pos);
+			mIndex.Clear();
+			return;
+		}
+	}
+	std::unique_ptr<Batch> batch(new Batch);
+	std::string raw;
+	// The time stamps are found in a mapping of the file, which only reads the start of the lines
+	uint64_t mapSize = mIndex.Position();
+	void *map = mapSize > 0 ? mmap(nullptr, mapSize, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+	if (map != MAP_FAILED)
+		LineStore::AddGuard(map, mapSize); // The file may be truncated while it is read
+	Defer unmap([map, mapSize]() {
+		if (map != MAP_FAILED) {
+			LineStore::RemoveGuard(map);
+			munmap(map, mapSize);
+		}
+	});
+	auto Flush = [&]() {
+		batch->fd = dup(fd);
+		this->Push(std::move(batch));
+		batch.reset(new Batch);
+	};
+	mIndex.ForEach([&](uint64_t pos, unsigned size, bool owned) {
+		if (owned) {
+			raw.resize(size);
+			if (size > 0 && pread(fd, &raw[0], size, pos) != ssize_t(size))
+				LPLOG("failed to read line at %llu", (unsigned long long)pos);
+			this->AddLine(raw.data(), size, false, cNotMapped, *batch);
+		} else {
+			batch->lines.push_back(Batch::Line{pos, size, false});
+			Timestamp::Time time;
+			if (map != MAP_FAILED)
+				batch->times.push_back(mSplitTimestamp.Parse((const char *)map + pos, size, &time) ? time : Timestamp::cNone);
+		}
+		batch->mapSize = pos + size;
+		if (batch->lines.size() == cIndexBatchLines)
+			Flush();
+		return !mStopUpdates;
+	});
+	if (!batch->lines.empty())
+		Flush();
+	mCurrentPosition = mIndex.Position();
+	mIndexSaved = mIndex.Position();
+#endif
+}
+
+// Executed by the main thread.
+Document::UpdateResult Document::UpdateInputData() {
+	Metrics::Scope scope(mMetrics, Metrics::Timer::Update);
+	if (this->Merged())
+		return this->Merge();
+	UpdateResult res = UpdateResult::NoChange;
+	unsigned numLines = mLines.size();
+	std::unique_ptr<Batch> batch;
+	for (unsigned i = 0; i < cMaxBatchesPerUpdate && mBatches.Pop(batch); i++) {
+		if (batch->result == UpdateResult::Replaced) {
+			this->ValidateLines(); // Keep what is left, if the file was truncated
+			return UpdateResult::Replaced;
+		}
+		if (batch->result == UpdateResult::Prepended) {
+			unsigned first = mLines.size();
+			this->Apply(*batch);
+			mPrepended = mLines.size() - first;
+			mLines.MoveToFront(first);
+			// All line numbers have changed, which means the strings have to be searched for again
+			mMatches.clear();
+			mFirstNewLine = 0;
+			mLastSearchLine = -1;
+			if (batch->fileStart)
+				mHeadMissing = false;
+			return UpdateResult::Prepended;
+		}
+		this->Apply(*batch);
+		res = UpdateResult::Grow;
+	}
+	if (!mBatches.Empty())
+		g_main_context_wakeup(nullptr); // Continue with the rest in next iteration of the main loop
+	this->UpdateRate(mLines.size() - numLines);
+	if (this->TakeLinesCut())
+		return UpdateResult::Changed;
+	return res;
+}
+
+bool Document::TakeLinesCut() {
+	this->ValidateLines(); // Lines may also have been cut by Apply()
+	if (!mLinesCut)
+		return false;
+	mLinesCut = false;
+	mLastSearchLine = -1;
+	mPrepended = 0;
+	return true;
+}
+
+void Document::UpdateRate(unsigned newLines) {
+	auto now = std::chrono::steady_clock::now();
+	mRateCount += newLines;
+	double elapsed = std::chrono::duration<double>(now - mRateStart).count();
+	if (elapsed < 1.0)
+		return;
+	mLinesPerSecond = unsigned(mRateCount / elapsed + 0.5);
+	mRateCount = 0;
+	mRateStart = now;
+}
+
+// The lines of the files are merged with a heap of the time of the next line of every file.
+Document::UpdateResult Document::Merge() {
+	unsigned numLines = mLines.size();
+	typedef std::pair<Timestamp::Time, unsigned> Next; // The time of the next line of a source, and the source
+	std::priority_queue<Next, std::vector<Next>, std::greater<Next>> heap;
+	bool blocked = false; // A file is being read, and the time of its next line isn't known
+	for (unsigned i = 0; i < mSources.size(); i++) {
+		Document &doc = *mSources[i].doc;
+		UpdateResult result = doc.UpdateInputData();
+		if (result == UpdateResult::Replaced) {
+			LPLOG("%s replaced, no longer merged", doc.GetFileName().c_str());
+			doc.StopUpdate();
+		}
+		if (result == UpdateResult::Changed)
+			doc.mLinesCut = true; // Taken by ValidateLines()
+		mFileTime = std::max(mFileTime.load(), doc.mFileTime.load());
+		if (mSources[i].next < doc.mLines.size())
+			heap.push(Next(doc.mTimes[mSources[i].next], i));
+		else if (doc.Loading())
+			blocked = true;
+	}
+	while (!blocked && !heap.empty()) {
+		unsigned i = heap.top().second;
+		heap.pop();
+		Source &source = mSources[i];
+		LineStore &lines = source.doc->mLines;
+		const TimeIndex &times = source.doc->mTimes;
+		// The line, and the lines after it that have no later time stamp
+		Timestamp::Time time = times[source.next];
+		for (; source.next < lines.size() && times[source.next] == time; source.next++) {
+			mLines.AddReference(&lines, source.next);
+			mTimes.Add(time);
+			mLineSource.push_back(i);
+		}
+		if (source.next < lines.size())
+			heap.push(Next(times[source.next], i));
+		else if (source.doc->Loading())
+			blocked = true;
+	}
+	this->UpdateRate(mLines.size() - numLines);
+	if (this->TakeLinesCut())
+		return UpdateResult::Changed;
+	return mLines.size() > numLines ? UpdateResult::Grow : UpdateResult::NoChange;
+}
+
+const std::string &Document::GetSourceName(unsigned line) const {
+	static const std::string none;
+	if (mLineSource.empty())
+		return none;
+	return mSources[mLineSource[line - mLines.First()]].name;
+}
+
+void Document::Apply(Batch &batch) {
+	if (batch.detach)
+		mLines.Detach(batch.truncated);
+	unsigned first = mLines.size();
+	bool mapped = batch.mapSize > 0 && mLines.Map(batch.fd, batch.mapSize);
+	for (auto &line : batch.lines) {
+		if (line.owned) {
+			mLines.AddOwned(batch.text.data() + line.pos, line.size);
+		} else if (mapped) {
+			mLines.AddMapped(line.pos, line.size);
+		} else {
+			// Mapping failed, fall back to a copy
+			std::string str(line.size, ' ');
+#ifndef _WIN32
+			if (pread(batch.fd, &str[0], line.size, line.pos) != ssize_t(line.size))
+				LPLOG("failed to read line at %llu", (unsigned long long)line.pos);
+#endif
+			mLines.AddOwned(str.data(), str.size());
+		}
+	}
+	this->AddTimes(batch, first);
+	LPTRACE("total %u document %p", mLines.size(), this);
+}
+
+// The time stamps are parsed once, when the lines are split, as the lines may be selected by time many times.
+void Document::AddTimes(Batch &batch, unsigned first) {
+	if (batch.times.size() != batch.lines.size()) {
+		// The worker thread couldn't map the file to find the times of the lines in the index
+		this->ValidateLines(); // The file may have been truncated since
+		batch.times.clear();
+		for (unsigned line = first; line < mLines.size(); line++) {
+			Timestamp::Time time;
+			batch.times.push_back(mTimestamp.Parse(mLines[line], &time) ? time : Timestamp::cNone);
+		}
+	}
+	if (batch.result == UpdateResult::Prepended) {
+		mTimes.Prepend(batch.times);
+		return;
+	}
+	for (auto time : batch.times)
+		mTimes.Add(time);
+}
+
+unsigned Document::GetLineAt(Timestamp::Time time, bool timeOfDay, unsigned line) const {
+	unsigned first = mTimes.First(), last = mTimes.size();
+	if (timeOfDay) {
+		// The day of the line, or of the first line that has a time
+		if (line < first || line >= last || mTimes[line] == Timestamp::cNone)
+			line = mTimes.Find(Timestamp::cNone + 1, first, last);
+		if (line == last)
+			return last;
+		time += Timestamp::Day(mTimes[line]) * Timestamp::cDay;
+	}
+	return mTimes.Find(time, first, last);
+}
+
+void Document::ValidateLines() {
+	// Testing the size of every mapped file has a cost, and is only done when one may have been truncated
+	unsigned faults = LineStore::Faults();
+	if (mShrunk.exchange(false) || faults != mFaults) {
+		mFaults = faults;
+		mLines.Validate();
+	}
+	bool cut = mLines.TakeCut();
+	// The lines of a merged document are the lines of the files
+	for (auto &source : mSources) {
+		source.doc->ValidateLines();
+		cut = cut || source.doc->mLinesCut;
+		source.doc->mLinesCut = false;
+	}
+	if (cut) {
+		LPLOG("lines cut, the strings found in them are forgotten");
+		mMatches.clear();
+		mLinesCut = true;
+	}
+}
+
+void Document::IterateLines(std::function<bool (const LineRef &, unsigned)> f, bool restartFirstLine) {
 	if (restartFirstLine) {
-		mFirstNewLine = 0;
+		mFirstNewLine = mLines.First();
 		mLineMap.clear();
 	}
-	LPLOG("from line %u restart '%s' printed line# %u", mFirstNewLine, restartFirstLine?"[true]":"[false]", (unsigned)mLineMap.size());
+	this->ValidateLines();
+	LPTRACE("from line %u restart '%s' printed line# %u", mFirstNewLine, restartFirstLine?"[true]":"[false]", (unsigned)mLineMap.size());
 	for (unsigned line = mFirstNewLine; line < mLines.size(); line++) {
 		bool accepted = f(mLines[line], line);
 		if (accepted) {
 			mLineMap.push_back(line);
 		}
 	}
+	mFirstNewLine = mLines.size();
 }
 
-void Document::SplitLines(char *buff, unsigned size) {
-	const char *last;
-	unsigned pos = 0;
-	unsigned numBad = 0;
+LineRef Document::GetShownLine(unsigned row, unsigned *lineNumber) const {
+	g_assert(row < mLineMap.size());
+	*lineNumber = mLineMap[row];
+	return mLines[*lineNumber];
+}
+
+unsigned Document::Evict() {
+	if ((mMaxLines == 0 && mMaxBytes == 0) || mHeadMissing)
+		return 0;
+	unsigned first = mLines.First(), last = mLines.size();
+	unsigned evict = first;
+	if (mMaxLines > 0 && last - first > mMaxLines)
+		evict = last - mMaxLines;
+	unsigned line = first;
+	for (uint64_t bytes = mLines.Bytes(); mMaxBytes > 0 && bytes > mMaxBytes && line < last; line++)
+		bytes -= mLines[line].size;
+	evict = std::max(evict, line);
+	// Rounded up to a block, unless that is all lines
+	unsigned rounded = (uint64_t(evict) + LineSet::cBlockSize - 1) / LineSet::cBlockSize * LineSet::cBlockSize;
+	evict = rounded <= last ? rounded : evict / LineSet::cBlockSize * LineSet::cBlockSize;
+	if (evict <= first)
+		return 0;
+	if (!mLineSource.empty()) {
+		// The files keep the lines that are still merged, which are the lines after those evicted
+		for (unsigned i = 0; i < evict - first; i++)
+			mSources[mLineSource[i]].evicted++;
+		for (auto &source : mSources) {
+			source.doc->mLines.Evict(source.evicted);
+			source.doc->mTimes.Evict(source.evicted);
+		}
+	}
+	mLines.Evict(evict);
+	mTimes.Evict(evict);
+	for (auto &matches : mMatches) {
+		matches.second.lines.EraseBefore(evict);
+		matches.second.numLines = std::max(matches.second.numLines, evict);
+	}
+	unsigned rows = this->GetShownRow(evict);
+	mLineMap.erase(mLineMap.begin(), mLineMap.begin() + rows);
+	if (!mLineSource.empty())
+		mLineSource.erase(mLineSource.begin(), mLineSource.begin() + (evict - first));
+	mFirstNewLine = std::max(mFirstNewLine, evict);
+	mLastSearchLine = std::max(-1, mLastSearchLine - int(rows));
+	LPLOG("%u lines and %u rows evicted, %u lines kept", evict - first, rows, last - evict);
+	return rows;
+}
+
+unsigned Document::GetShownRow(unsigned lineNumber) const {
+	return std::lower_bound(mLineMap.begin(), mLineMap.end(), lineNumber) - mLineMap.begin();
+}
+
+int Document::FindRow(const Finder &finder, int row, int direction, size_t *offset, size_t *length) {
+	this->ValidateLines();
+	for (; row >= 0 && row < int(mLineMap.size()); row += direction) {
+		size_t pos = finder.Find(mLines[mLineMap[row]], length);
+		if (pos != Finder::npos) {
+			*offset = pos;
+			return row;
+		}
+	}
+	return -1;
+}
+
+void Document::IterateLinesParallel(ThreadPool &pool, const LineSet &lines, unsigned numChunks,
+									std::function<bool (const LineRef &, unsigned, unsigned)> test,
+									std::function<void (unsigned, std::vector<unsigned> &)> merge) {
+	mLineMap.clear();
+	this->ValidateLines();
+	unsigned firstLine = mLines.First();
+	unsigned numLines = mLines.size();
+	LPLOG("%u lines in %u chunks", numLines - firstLine, numChunks);
+	std::vector<std::vector<unsigned>> accepted(numChunks);
+	pool.ParallelFor(numChunks, [&](unsigned chunk) {
+		unsigned first = firstLine + uint64_t(numLines - firstLine) * chunk / numChunks;
+		unsigned last = firstLine + uint64_t(numLines - firstLine) * (chunk + 1) / numChunks;
+		lines.ForEach(first, last, [&](unsigned line) {
+			if (test(mLines[line], line, chunk))
+				accepted[chunk].push_back(line);
+		});
+	});
+	for (unsigned chunk = 0; chunk < numChunks; chunk++) {
+		merge(chunk, accepted[chunk]);
+		mLineMap.insert(mLineMap.end(), accepted[chunk].begin(), accepted[chunk].end());
+	}
+	mFirstNewLine = numLines;
+}
+
+LineSet Document::Select(const Filter &filter, ThreadPool &pool, bool restartFirstLine, Filter::Profile *profile) {
+	this->ValidateLines();
+	unsigned numLines = mLines.size();
+	mSelectCount++;
+	auto &strings = filter.Strings();
+	// Find what strings have lines that were not searched yet
+	std::vector<const LineSet *> lines;
+	std::vector<Matches *> stale;
+	std::vector<unsigned> staleIndex; // Index in 'strings' of every string in 'stale'
+	StringSearch search;
+	unsigned first = numLines;
+	for (unsigned i = 0; i < strings.size(); i++) {
+		Matches &matches = mMatches[strings[i]];
+		matches.lastUsed = mSelectCount;
+		lines.push_back(&matches.lines);
+		if (matches.numLines < numLines) {
+			stale.push_back(&matches);
+			staleIndex.push_back(i);
+			search.Add(strings, i);
+			first = std::min(first, matches.numLines);
+		}
+	}
+	std::vector<double> searchTime(strings.size());
+	if (!stale.empty()) {
+		auto start = std::chrono::steady_clock::now();
+		search.Prepare();
+		this->Search(search, stale, first, pool);
+		// The strings are found in the same pass over the lines, so the time can't be told apart.
+		// Share it equally, which is good enough to see what part of the filter is expensive.
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		for (unsigned i : staleIndex)
+			searchTime[i] = seconds / stale.size();
+	}
+	// Forget strings that haven't been used for the longest time
+	while (mMatches.size() > strings.size() + cMaxUnusedMatches) {
+		auto oldest = std::min_element(mMatches.begin(), mMatches.end(),
+			[](const std::pair<const std::string, Matches> &a, const std::pair<const std::string, Matches> &b) { return a.second.lastUsed < b.second.lastUsed; });
+		mMatches.erase(oldest);
+	}
+	return filter.Select(lines, mTimes, restartFirstLine ? mLines.First() : mFirstNewLine, numLines, profile, &searchTime);
+}
+
+// Find the lines, from 'first', that contain the strings. Lines that were searched before for a string are skipped.
+void Document::Search(const StringSearch &search, const std::vector<Matches *> &matches, unsigned first, ThreadPool &pool) {
+	unsigned numLines = mLines.size();
+	first = std::max(first, mLines.First()); // Lines not searched before may have been evicted
+	// Chunks are aligned with the blocks of LineSet, so the results can be appended without any conversion.
+	const unsigned chunkSize = 65536;
+	unsigned firstChunk = first / chunkSize;
+	unsigned numChunks = (numLines - 1) / chunkSize + 1 - firstChunk;
+	std::vector<std::vector<LineSet>> results(numChunks, std::vector<LineSet>(matches.size()));
+	LPLOG("%u strings from line %u", search.size(), first);
+	pool.ParallelFor(numChunks, [&](unsigned chunk) {
+		unsigned start = std::max(first, (firstChunk + chunk) * chunkSize);
+		unsigned last = std::min(numLines, (firstChunk + chunk + 1) * chunkSize);
+		std::vector<uint64_t> found(search.Words());
+		for (unsigned line = start; line < last; line++) {
+			std::fill(found.begin(), found.end(), 0);
+			search.FindAll(mLines[line], found.data());
+			for (unsigned w = 0; w < found.size(); w++) {
+				for (uint64_t word = found[w]; word != 0; word &= word - 1) {
+					unsigned i = w * 64 + __builtin_ctzll(word);
+					if (line >= matches[i]->numLines)
+						results[chunk][i].Add(line);
+				}
+			}
+		}
+	});
+	for (unsigned i = 0; i < matches.size(); i++) {
+		for (auto &chunk : results)
+			matches[i]->lines.Append(chunk[i]);
+		matches[i]->numLines = numLines;
+	}
+}
+
+void Document::SplitLines(const char *buff, uint64_t size, uint64_t fileOffset, Batch &batch) {
+	Metrics::Scope scope(mMetrics, Metrics::Timer::Split);
 	Defer freeTmp; // Default, nothing done
 	if (mInputType == InputType::UTF16BigEndian || mInputType == InputType::UTF16LittleEndian) {
+		g_assert(fileOffset == cNotMapped);
 		long numWritten;
-		char *ret = g_utf16_to_utf8((const gunichar2 *)buff, size, NULL, &numWritten, NULL);
+		char *ret = g_utf16_to_utf8((const gunichar2 *)buff, size/2, NULL, &numWritten, NULL);
 		if (ret == nullptr) {
 			LPLOG("failed conversion");
-		} else {
-			freeTmp = [ret]() { g_free(ret); };
-			LPLOG("parsed %ld chars from %d",numWritten, size);
-			buff = ret; // Use this buffer instead
-			size = numWritten;
+			return;
 		}
-	} else {
-		for(char *p = buff; !g_utf8_validate(p, size - pos, &last); p += pos) {
-			// TODO: Convert from ASCII to utf-8 instead
-			unsigned pos = last - buff;
-			if (buff[pos] == 0) {
-				LPLOG("premature zero byte at pos %d", pos);
-				size = pos;
-				break;
-			}
-			buff[pos] = ' ';
-			numBad++;
+		freeTmp = [ret]() { g_free(ret); };
+		LPTRACE("parsed %ld chars from %d",numWritten, (unsigned)size);
+		buff = ret; // Use this buffer instead
+		size = numWritten;
+	}
+	// Split the source into list of lines, one chunk at a time to keep the list of spans small.
+	std::vector<LineSpan> spans;
+	uint64_t chunk = cSplitChunkSize;
+	for (uint64_t pos = 0; pos < size; ) {
+		bool moreFollows = pos + chunk < size;
+		size_t len = moreFollows ? chunk : size - pos;
+		size_t end;
+		spans.clear();
+		size_t next = LineSplitter::Split(buff + pos, len, spans, &end, moreFollows);
+		for (auto &span : spans) {
+			uint64_t offset = fileOffset == cNotMapped ? cNotMapped : fileOffset + pos + span.start;
+			this->AddLine(buff + pos + span.start, span.size, span.valid, offset, batch);
 		}
-		if (numBad > 0)
-			LPLOG("%d bad characters", numBad);
-	}
-	buff[size] = 0;
-	// Split the source into list of lines
-	for (const char *p=buff;;) {
-		unsigned len;
-		const char *next;
-		if (!findNL(p, &len, &next))
-			break;
-		if (p[len] == '\0') {
-			// No newline, means the line is incomplete.
-			mIncompleteLastLine += std::string(p, len);
-			LPLOG("incomplete last line (%u chars) '%s'", len, mIncompleteLastLine.c_str());
+		if (fileOffset != cNotMapped)
+			mIndex.SetPosition(fileOffset + pos + next);
+		if (end < len || !moreFollows) {
+			if (end < len) {
+				LPLOG("premature zero byte at pos %u", unsigned(pos + end));
+				mUseIndex = false; // The lines no longer follow the content of the file
+			}
+			if (next < end) {
+				// No newline, means the line is incomplete.
+				if (mIncompleteLastLine == "" && fileOffset != cNotMapped)
+					mIncompleteLineOffset = fileOffset + pos + next;
+				mIncompleteLastLine += std::string(buff + pos + next, end - next);
+				LPTRACE("incomplete last line (%u chars) '%s'", unsigned(end - next), mIncompleteLastLine.c_str());
+			}
 			break;
 		}
-		// Add a new line
-		mLines.push_back(mIncompleteLastLine + std::string(p, len));
-		if (mIncompleteLastLine != "")
-			LPLOG("merged incomplete last line '%s'", (mIncompleteLastLine + std::string(p, len)).c_str());
-		mIncompleteLastLine = "";
-		p = next;
+		if (spans.empty()) {
+			chunk *= 2; // A line longer than the chunk
+			continue;
+		}
+		pos += next;
+		chunk = cSplitChunkSize;
 	}
-	LPLOG("total %u,%s document %p", (unsigned)mLines.size(), mIncompleteLastLine != "" ? " incomplete last, " : "", this);
+	LPTRACE("%u lines,%s document %p", (unsigned)batch.lines.size(), mIncompleteLastLine != "" ? " incomplete last, " : "", this);
+}
+
+void Document::AddLine(const char *p, unsigned len, bool valid, uint64_t fileOffset, Batch &batch) {
+	Timestamp::Time time;
+	if (mIncompleteLastLine == "" && valid && memchr(p, '\033', len) == nullptr) {
+		batch.times.push_back(mSplitTimestamp.Parse(p, len, &time) ? time : Timestamp::cNone);
+		if (fileOffset != cNotMapped) {
+			batch.lines.push_back(Batch::Line{fileOffset, len, false});
+			if (mUseIndex)
+				mIndex.Add(fileOffset, len, false);
+		} else {
+			batch.lines.push_back(Batch::Line{batch.text.size(), len, true});
+			batch.text.append(p, len);
+		}
+		return;
+	}
+	// The line has to be modified, which means it has to be copied.
+	if (fileOffset != cNotMapped && mUseIndex) {
+		// Remember where the line came from, to make it again from the file
+		uint64_t start = mIncompleteLastLine == "" ? fileOffset : mIncompleteLineOffset;
+		mIndex.Add(start, unsigned(fileOffset + len - start), true);
+	}
+	std::string line = mIncompleteLastLine + std::string(p, len);
+	if (mIncompleteLastLine != "")
+		LPTRACE("merged incomplete last line '%s'", line.c_str());
+	mIncompleteLastLine = "";
+	unsigned numBad = 0;
+	const char *last;
+	for (unsigned pos = 0; !g_utf8_validate(line.c_str() + pos, line.size() - pos, &last); ) {
+		// TODO: Convert from ASCII to utf-8 instead
+		pos = last - line.c_str();
+		line[pos] = ' ';
+		numBad++;
+	}
+	if (numBad > 0)
+		LPTRACE("%d bad characters", numBad);
+	RemoveColorEscapeSequences(line);
+	batch.times.push_back(mSplitTimestamp.Parse(line.data(), line.size(), &time) ? time : Timestamp::cNone);
+	batch.lines.push_back(Batch::Line{batch.text.size(), unsigned(line.size()), true});
+	batch.text += line;
 }
 
 // A color marking is ESC + [, two digits and a character. 5 Characters in total.
-void Document::RemoveColorEscapeSequences() {
-	auto f = [](std::string& line, unsigned){
-		for (size_t pos = 0; pos < line.size();) {
-			pos = line.find("\033[", pos);
-			if (pos <= line.size()) {
-				if (line[pos+2] == '0')
-					line = line.erase(pos, 4);
-				else
-					line = line.erase(pos, 5);
-			}
+bool Document::RemoveColorEscapeSequences(std::string &line) {
+	bool removed = false;
+	for (size_t pos = 0; pos < line.size();) {
+		pos = line.find("\033[", pos);
+		if (pos <= line.size()) {
+			if (line[pos+2] == '0')
+				line = line.erase(pos, 4);
+			else
+				line = line.erase(pos, 5);
+			removed = true;
 		}
-		return false;
-	};
-	this->IterateLines(f, false);
+	}
+	return removed;
+}
+
+uint64_t Document::MemoryUsage() const {
+	uint64_t bytes = mLines.MemoryUsage() + mLineMap.size() * sizeof mLineMap[0];
+	for (auto &matches : mMatches)
+		bytes += matches.second.lines.MemoryUsage();
+	bytes += mLineSource.size() * sizeof mLineSource[0] + mTimes.MemoryUsage();
+	for (auto &source : mSources)
+		bytes += source.doc->MemoryUsage();
+	return bytes;
+}
+
+std::string Document::PerformanceReport() const {
+	uint64_t matches = 0;
+	for (auto &m : mMatches)
+		matches += m.second.lines.MemoryUsage();
+	// The file name has no limit on its length, so no fixed buffer
+	std::ostringstream out;
+	out << std::fixed << std::setprecision(1);
+	out << mFileName << '\n' << mLines.size() << " lines, " << mLineMap.size() << " shown, " << mMetrics.Bytes() / 1e6 << " MB read, "
+		<< mLinesPerSecond << " lines/s incoming\n"
+		<< "memory " << this->MemoryUsage() / 1e6 << " MB: lines " << mLines.MemoryUsage() / 1e6 << " MB, shown "
+		<< mLineMap.size() * sizeof mLineMap[0] / 1e6 << " MB, lines with filter strings " << matches / 1e6 << " MB\n";
+	if (mTimes.Clamped() > 0)
+		out << mTimes.Clamped() << " lines with an earlier time than a line before, given the time of that line\n";
+	std::string report = out.str() + mMetrics.Report();
+	for (auto &source : mSources)
+		report += "\nMerged from " + source.doc->PerformanceReport();
+	return report;
 }
 
 std::string Document::GetFileNameShort() const {
@@ -297,6 +1120,31 @@ std::string Document::GetFileNameShort() const {
 	return mFileName.substr(pos);
 }
 
+std::vector<std::string> Document::MatchFileNames(const std::string &pattern) {
+	std::vector<std::string> fileNames;
+	if (pattern.find_first_of("*?") == std::string::npos) {
+		fileNames.push_back(pattern);
+		return fileNames;
+	}
+	gchar *dirName = g_path_get_dirname(pattern.c_str());
+	gchar *baseName = g_path_get_basename(pattern.c_str());
+	Defer free([dirName, baseName]() { g_free(dirName); g_free(baseName); });
+	GDir *dir = g_dir_open(dirName, 0, nullptr);
+	if (dir == nullptr)
+		return fileNames;
+	while (const gchar *name = g_dir_read_name(dir)) {
+		if (!g_pattern_match_simple(baseName, name))
+			continue;
+		// A name without a directory is kept that way, e.g. "*.log"
+		std::string fileName = pattern.find_first_of("/\\") == std::string::npos ? name : std::string(dirName) + G_DIR_SEPARATOR_S + name;
+		if (g_file_test(fileName.c_str(), G_FILE_TEST_IS_REGULAR))
+			fileNames.push_back(fileName);
+	}
+	g_dir_close(dir);
+	std::sort(fileNames.begin(), fileNames.end());
+	return fileNames;
+}
+
 const std::string &Document::GetFileName() const {
 	return mFileName;
 }
@@ -20,45 +20,266 @@
 #include <string>
 #include <functional>
 #include <ctime>
+#include <chrono>
 #include <cstdio>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <map>
+#include <deque>
+#include <list>
+
+#include "LineStore.h"
+#include "FileWatcher.h"
+#include "SpscQueue.h"
+#include "LineSet.h"
+#include "Metrics.h"
+#include "Filter.h"
+#include "LineIndex.h"
+#include "Timestamp.h"
+#include "TimeIndex.h"
+
+class ThreadPool;
+class StringSearch;
+class LogView;
+class Finder;
 
 // This class represents the "model" of MVC.
+// Files are read and split into lines by a worker thread. The lines are handed over to the
+// main thread in batches, and only the main thread accesses the list of lines.
 
 class Document
 {
 public:
+	~Document();
 	void AddSourceFile(const std::string &fileName); // Add a source file
+	// Merge several files into one document, in the order of the time stamps at the start of the lines. Every file
+	// is read by a document of its own, and the lines are merged as they come in. A line without a time stamp stays
+	// after the line before it. While a file is being read, lines are only merged up to the time of its next line.
+	// Lines that come later with an earlier time, e.g. from a file that was quiet for a while, are added at the end.
+	// The time stamps are found with the format given to SetTimestamp().
+	void AddSourceFiles(const std::vector<std::string> &fileNames);
+	bool Merged() const { return !mSources.empty(); }
+	const std::string &GetSourceName(unsigned line) const; // The short name of the file of a line, if merged
+	unsigned SourceNameSize() const { return mSourceNameSize; } // The longest name
+	// The files that match a pattern, with '*' and '?' in the last part of it, in sorted order
+	static std::vector<std::string> MatchFileNames(const std::string &pattern);
+	// A big file is indexed, to be quick to open the next time. Call before AddSourceFile() to not use the index.
+	void SetUseIndex(bool use) { mUseIndex = use; }
+	// Read the end of a big file first, to show it right away. The start of the file is then read in the background,
+	// a part at a time from the back, and every part is added before the other lines. Line numbers change with every
+	// part, and are counted from the end that was read first until all of the start is read.
+	// Call before AddSourceFile().
+	void SetTailFirst(bool tailFirst) { mTailFirst = tailFirst; }
+	bool HeadMissing() const { return mHeadMissing; } // The start of the file is not read yet
+	// Follow the file by its device and inode, instead of giving up when it is replaced. When the file is rotated
+	// by renaming it, the rest of the old file is read before the new file. When the file is truncated, it is read
+	// from the start again. The lines are added to this document in both cases. Not used on Windows.
+	// Call before AddSourceFile().
+	void SetFollow(bool follow) { mFollow = follow; }
+	// Keep at most this many lines, or this many bytes of lines, where 0 is no limit. The oldest lines are
+	// evicted by Evict(). The end of a big file isn't read first, as the start would only be evicted.
+	// Call before AddSourceFile().
+	void SetRetention(unsigned maxLines, uint64_t maxBytes) { mMaxLines = maxLines; mMaxBytes = maxBytes; }
+	// The format of the time stamps at the start of the lines. The time of every line is found when it is added,
+	// which is what a filter with a range of time, and GetLineAt(), use. Call before AddSourceFile().
+	void SetTimestamp(const Timestamp &timestamp) { mTimestamp = mSplitTimestamp = timestamp; }
+	bool HasTimes() const { return mTimes.Last() != Timestamp::cNone; } // Any line has a time stamp
+	Timestamp::Time GetTime(unsigned line) const { return mTimes[line]; } // cNone before the first time stamp
+	unsigned TimesOutOfOrder() const { return mTimes.Clamped(); } // Lines with an earlier time than a line before
+	// The first line that has the time or later, or GetNumLines() if there is none. A time of day, without a date,
+	// is on the day of 'line'.
+	unsigned GetLineAt(Timestamp::Time, bool timeOfDay, unsigned line) const;
+	// Forget the oldest lines, if there are more than allowed. Lines are evicted a LineSet block at a time,
+	// which keeps the cost of every eviction the same however many lines there are. Lines keep their numbers,
+	// but rows are removed from the start. Return the number of rows removed.
+	unsigned Evict();
+	unsigned PrependedLines() const { return mPrepended; } // Lines added before the others by UpdateInputData()
 	void AddSourceText(char *, unsigned size); // Add text
 	enum class UpdateResult {
 		NoChange, // The same content, no change
 		Grow,     // New content added
-		Replaced  // New file
+		Replaced, // New file
+		Prepended, // The start of the file was added before the lines, see SetTailFirst()
+		Changed    // Lines were cut, as the file was truncated, and all lines have to be filtered again
 	};
-	UpdateResult UpdateInputData(); // Update from file
+	UpdateResult UpdateInputData(); // Take care of new data from the worker thread
+	unsigned LinesPerSecond() const { return mLinesPerSecond; } // The rate of new lines, measured over the last second
+	void RequestUpdate();           // Ask the worker thread to read new data from the file
+	bool Loading();                 // True until all data requested from the worker thread is taken care of
+	bool TakeActivity();            // Return true if the worker found new data since last call
 	const std::string &GetFileName() const;
 	std::string GetFileNameShort() const; // Get the last part of the filename
-	// Iterate a function over the lines in the input document. 'f' shall return true for lines that were added.
-	void IterateLines(std::function<bool (std::string&, unsigned)> f, bool restartFirstLine);
-	unsigned GetNumLines() { return mLines.size(); }
+	// Iterate a function over the lines in the input document, from the first line or from the first line not
+	// iterated before. 'f' shall return true for lines that were added.
+	void IterateLines(std::function<bool (const LineRef &, unsigned)> f, bool restartFirstLine);
+	// The same as IterateLines() from the first line, but only for 'lines', which are split into chunks that are tested in parallel.
+	// 'test' is called for the lines of a chunk in order, but chunks are done at the same time by different threads.
+	// 'merge' is then called from this thread for every chunk in order, with the lines accepted. It may remove lines.
+	void IterateLinesParallel(ThreadPool &, const LineSet &lines, unsigned numChunks,
+							  std::function<bool (const LineRef &, unsigned line, unsigned chunk)> test,
+							  std::function<void (unsigned chunk, std::vector<unsigned> &accepted)> merge);
+	// The lines shown by the filter, from the first line or from the first new line. The lines that contain each
+	// string of the filter are remembered, which means only lines that weren't searched before need to be searched.
+	// The cost of every node of the filter is added to 'profile', if given.
+	LineSet Select(const Filter &, ThreadPool &, bool restartFirstLine, Filter::Profile *profile = nullptr);
+	unsigned GetNumLines() { return mLines.size(); } // Including lines evicted
+	unsigned GetFirstLine() const { return mLines.First(); } // The first line that wasn't evicted
+	// The lines that passed the filter, in the order shown. ValidateLines() cuts the lines of a file that was truncated.
+	unsigned GetNumShownLines() const { return mLineMap.size(); }
+	LineRef GetShownLine(unsigned row, unsigned *lineNumber) const;
+	void ValidateLines();
+	unsigned GetShownRow(unsigned lineNumber) const; // The first row that shows the line or a line after it
+	// Find the first shown row from 'row', going in 'direction' (1 or -1), that contains the string. Return -1 if
+	// there is none, otherwise '*offset' and '*length' are the position in the line and the size of the match.
+	int FindRow(const Finder &, int row, int direction, size_t *offset, size_t *length);
 	std::string Date() const;
 	void StopUpdate();
+	Metrics &GetMetrics() { return mMetrics; }
+	uint64_t MemoryUsage() const; // Approximate number of bytes allocated, not counting the mapped file
+	std::string PerformanceReport() const; // Lines, memory and timers, as text
+	// Call 'cb' when the source file may have changed
+	void Watch(FileWatcher::Callback cb, unsigned maxPollPeriod);
 
-	GtkScrolledWindow *mScrolledView = 0; // TODO: Should not be public, manage in a better way.
-	GtkTextView *mTextView = 0;           // TODO: Should not be public, manage in a better way.
+	LogView *mLogView = 0;                // TODO: Should not be public, manage in a better way.
 	int mLastSearchLine = -1;             // To know where "find next" should continue. -1 means before first line.
 	void ResetSearch() { mLastSearchLine = -1; }
 private:
-	std::vector<std::string> mLines;        // The input document
+	// Lines produced by the worker thread, to be added to mLines.
+	struct Batch {
+		UpdateResult result = UpdateResult::Grow;
+		bool detach = false;    // The lines that follow refer to another file, or to the same file truncated
+		bool truncated = false; // The content of the file read before is gone
+		bool fileStart = false; // Prepended lines from the start of the file, the last to be prepended
+		int fd = -1;          // Descriptor of the file, if lines refer to it
+		uint64_t mapSize = 0; // The file size needed for the lines that refer to it
+		struct Line {
+			uint64_t pos;     // Offset in the file, or in 'text' if owned
+			unsigned size;
+			bool owned;
+		};
+		std::vector<Line> lines;
+		std::string text;     // Content of lines that had to be copied
+		std::vector<Timestamp::Time> times; // Of every line, unless the worker thread failed to read them
+		~Batch();
+	};
+	static const uint64_t cNotMapped = ~uint64_t(0);
+	static const unsigned cReadChunkSize = 16*1024*1024; // Size of data read for one batch
+	static const unsigned cMaxBatchesPerUpdate = 4;     // Keep the main loop responsive when a big file is loaded
+
+	// Data used by the main thread
+	LineStore mLines;                       // The input document
+	TimeIndex mTimes;                       // The time of every line in mLines
 	std::string mFileName;
+	unsigned mFirstNewLine = 0; // The first line not yet iterated, which may include several updates
+	FileWatcher mWatcher;
+	std::deque<unsigned> mLineMap;          // Map from printed line number to document line number
+	void Apply(Batch &);
+	void AddTimes(Batch &, unsigned first); // Add the times of the lines of the batch, added from 'first'
+	std::chrono::steady_clock::time_point mRateStart; // Start of the period lines are counted for
+	unsigned mRateCount = 0;
+	unsigned mLinesPerSecond = 0;
+	void UpdateRate(unsigned newLines);
+	unsigned mPrepended = 0;
+	unsigned mMaxLines = 0;
+	uint64_t mMaxBytes = 0;
+	Metrics mMetrics;
+
+	// The files of a merged document, which are read into documents of their own. The lines of the merged document
+	// refer to the lines of their files, which are evicted when they are evicted from the merged document.
+	// The times of the lines are found by the documents of the files.
+	struct Source {
+		Document *doc;
+		std::string name;
+		unsigned next;             // The first line not merged
+		unsigned evicted;          // Lines evicted from the merged document
+	};
+	std::list<Document> mSourceDocs;
+	std::vector<Source> mSources;
+	std::deque<uint16_t> mLineSource; // Index in mSources of every line kept
+	unsigned mSourceNameSize = 0;
+	Timestamp mTimestamp;
+	UpdateResult Merge(); // UpdateInputData() of a merged document
+
+	// The lines that contain a string, for strings used by the filter now or recently.
+	// This depends on lines never being changed, only added. They are forgotten if lines are cut, see ValidateLines().
+	struct Matches {
+		LineSet lines;
+		unsigned numLines = 0; // Lines searched so far
+		unsigned lastUsed = 0;
+	};
+	std::map<std::string, Matches> mMatches;
+	bool mLinesCut = false; // Lines were cut since UpdateInputData() was called
+	std::atomic<bool> mShrunk{false}; // The worker thread found the file smaller, see ValidateLines()
+	unsigned mFaults = 0;             // LineStore::Faults() when the lines were last validated
+	bool TakeLinesCut();    // If true, UpdateInputData() returns UpdateResult::Changed
+	unsigned mSelectCount = 0;
+	static const unsigned cMaxUnusedMatches = 64; // Strings no longer used that are remembered
+	void Search(const StringSearch &, const std::vector<Matches *> &, unsigned first, ThreadPool &);
+
+	// Data shared between threads
+	SpscQueue<std::unique_ptr<Batch>, 16> mBatches;
+	std::atomic<bool> mStopUpdates{false};
+	std::atomic<bool> mActivity{false};
+	std::atomic<std::time_t> mFileTime{0};
+	std::thread mWorker;
+	std::mutex mWakeMutex;
+	std::condition_variable mWake;
+	bool mUpdateRequested = false; // Protected by mWakeMutex
+	bool mQuit = false;            // Protected by mWakeMutex
+	bool mReading = false;         // Protected by mWakeMutex
+	bool mTailFirst = false;       // Set before the worker is started
+	bool mFollow = false;          // Set before the worker is started
+	std::atomic<bool> mHeadMissing{false};
+	void WorkerThread();
+	void Push(std::unique_ptr<Batch>);
+
+	// Data used by the worker thread
 	long mCurrentPosition = 0; // Position in input buffer where next read should start.
-	unsigned mFirstNewLine = 0; // After updating, this is the first line with new data
-	bool mStopUpdates = false;
 	std::string mIncompleteLastLine; // If the last line didn't end with a newline, stash it away for later
-	std::time_t mFileTime = {0};
 	long mFileSize = 0;
-	std::vector<unsigned> mLineMap;         // Map from printed line number to document line number
-	void SplitLines(char *, unsigned size); // This will modify the buffer content
-	void RemoveColorEscapeSequences();
+	void ReadInput();
+	void ReadFile(std::FILE *input, long size, bool mapped); // Read from mCurrentPosition to 'size'
+	std::FILE *mFollowed = nullptr; // The file followed, kept open to read the rest of it after it is renamed
+	void ReadFollowed(); // Read what was added to the followed file, whatever its name is now
+	void StartAgain(bool truncated); // Continue from the start of a new file, or of the same file truncated
+	bool mCopyLines = false; // Lines are copied instead of referring to the file, as it is truncated now and then
+	// Split a buffer into lines. If 'fileOffset' isn't cNotMapped, it is the position of the buffer in the file.
+	void SplitLines(const char *, uint64_t size, uint64_t fileOffset, Batch &);
+	void AddLine(const char *, unsigned size, bool valid, uint64_t fileOffset, Batch &);
+	static const unsigned cSplitChunkSize = 1024*1024;
+	static bool RemoveColorEscapeSequences(std::string &); // Return true if anything was removed
+	uint64_t mIncompleteLineOffset = 0; // Position in the file of mIncompleteLastLine
+	Timestamp mSplitTimestamp; // A copy of mTimestamp, as the format found last is remembered
+
+	// The lines read from the file, saved to make the file quick to open again
+	LineIndex mIndex;
+	bool mUseIndex = true;
+	uint64_t mIndexSaved = 0; // Position of the index when it was saved
+	static const uint64_t cIndexSaveInterval = 64*1024*1024; // Bytes read before the index is saved (again)
+	static const unsigned cIndexBatchLines = 1024*1024;      // Lines in a batch from the index
+	LineIndex::Fingerprint GetFingerprint(const struct stat &) const;
+	void LoadIndex(std::FILE *input, const struct stat &);
+	void SaveIndex(const struct stat &); // If enough was added since it was saved
+
+	// The start of the file, up to mHeadEnd, when the end was read first. It is read backwards, a part at a time,
+	// and every part is handed over to go before the lines so far. It is split with its own incomplete line and index.
+	// The indexes of the parts are put together when all are read.
+	uint64_t mHeadEnd = 0; // 0 when there is nothing more to read at the start
+	std::string mHeadIncompleteLine;
+	uint64_t mHeadIncompleteOffset = 0;
+	LineIndex mHeadIndex;
+	std::vector<LineIndex> mHeadIndexes; // The last part first
+	static const uint64_t cTailFirstSize = 256*1024*1024; // Smaller files are read from the start
+	static const unsigned cTailLines = 10000;             // Lines read first, at the end of the file
+	static const uint64_t cMaxTailSize = 64*1024*1024;    // Bytes read first, even if the lines are fewer
+	static const uint64_t cHeadPartSize = 64*1024*1024;   // Read at a time, the end of the file is followed in between
+	uint64_t FindTailStart(int fd, uint64_t size);
+	uint64_t FindLineStart(int fd, uint64_t pos); // The start of the line that has the byte at 'pos'
+	bool ReadHead(); // Read a part of the start of the file. Return true if there is more.
+	void SwapHead();
 
 	static const unsigned cTestSize = 4*1024; // Small enough to be quick to read, big enough to consistently detect changed file content
 	char mTestBuffer[cTestSize];
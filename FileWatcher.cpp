@@ -0,0 +1,207 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <algorithm>
+#include <cerrno>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/vfs.h>
+#endif
+
+#include "FileWatcher.h"
+#include "Debug.h"
+
+const unsigned FileWatcher::cMinPollPeriod;
+
+void FileWatcher::Start(const std::string &fileName, Callback cb, unsigned maxPollPeriod) {
+	Stop();
+	mFileName = fileName;
+	mCallback = cb;
+	mActive = true;
+	mMaxPollPeriod = std::max(maxPollPeriod, cMinPollPeriod);
+	mPollPeriod = cMinPollPeriod;
+	if (StartNotification()) {
+		LPLOG("notification for '%s'", mFileName.c_str());
+		return;
+	}
+	LPLOG("polling '%s', at most every %u ms", mFileName.c_str(), mMaxPollPeriod);
+	Schedule(mPollPeriod);
+}
+
+void FileWatcher::Stop() {
+	mActive = false;
+	if (mTimer != 0)
+		g_source_remove(mTimer);
+	mTimer = 0;
+	StopNotification();
+}
+
+void FileWatcher::Schedule(unsigned ms) {
+	if (mTimer == 0)
+		mTimer = g_timeout_add(ms, TimerCB, this);
+}
+
+gboolean FileWatcher::TimerCB(gpointer data) {
+	((FileWatcher *)data)->Timer();
+	return false; // Always one-shot, the next one is scheduled explicitly
+}
+
+void FileWatcher::Timer() {
+	mTimer = 0;
+	bool changed = mCallback();
+	if (!mActive || UsingNotification())
+		return; // Stopped by the callback, or notifications will trigger the next one.
+	// Poll quickly while the file is growing, and back off while it is quiet.
+	if (changed)
+		mPollPeriod = cMinPollPeriod;
+	else
+		mPollPeriod = std::min(mPollPeriod * 2, mMaxPollPeriod);
+	Schedule(mPollPeriod);
+}
+
+#ifdef __linux__
+// File systems where changes made by other hosts are not reported by inotify.
+static bool IsRemoteFileSystem(const std::string &path) {
+	struct statfs st;
+	if (statfs(path.c_str(), &st) != 0)
+		return false;
+	switch ((unsigned long)st.f_type) {
+	case 0x6969:     // NFS
+	case 0x517b:     // SMB
+	case 0xff534d42: // CIFS
+	case 0xfe534d42: // SMB2
+	case 0x65735546: // FUSE, e.g. sshfs
+	case 0x01021997: // 9P
+	case 0x5346414f: // AFS
+		return true;
+	}
+	return false;
+}
+#endif
+
+bool FileWatcher::StartNotification() {
+#ifdef __linux__
+	std::string dir = ".";
+	auto pos = mFileName.rfind('/');
+	if (pos != std::string::npos)
+		dir = mFileName.substr(0, std::max(pos, std::string::size_type(1)));
+	if (IsRemoteFileSystem(dir)) {
+		LPLOG("remote file system for '%s'", dir.c_str());
+		return false;
+	}
+	mInotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (mInotify == -1) {
+		LPLOG("inotify_init1 failed (err %d)", errno);
+		return false;
+	}
+	// The directory is watched to find out when the file is created again, e.g. after rotation.
+	mDirWatch = inotify_add_watch(mInotify, dir.c_str(), IN_CREATE | IN_MOVED_TO);
+	if (mDirWatch == -1) {
+		LPLOG("inotify_add_watch '%s' failed (err %d)", dir.c_str(), errno);
+		StopNotification();
+		return false;
+	}
+	AddFileWatch();
+	mChannel = g_io_channel_unix_new(mInotify);
+	mIoSource = g_io_add_watch(mChannel, GIOCondition(G_IO_IN | G_IO_ERR | G_IO_HUP), NotificationCB, this);
+	return true;
+#else
+	return false;
+#endif
+}
+
+void FileWatcher::StopNotification() {
+#ifdef __linux__
+	if (mIoSource != 0)
+		g_source_remove(mIoSource);
+	mIoSource = 0;
+	if (mChannel != nullptr)
+		g_io_channel_unref(mChannel);
+	mChannel = nullptr;
+	if (mInotify != -1)
+		close(mInotify); // Also removes all watches
+	mInotify = -1;
+	mFileWatch = -1;
+	mMovedWatch = -1;
+	mDirWatch = -1;
+#endif
+}
+
+void FileWatcher::AddFileWatch() {
+#ifdef __linux__
+	if (mFileWatch != -1)
+		inotify_rm_watch(mInotify, mFileWatch);
+	mFileWatch = inotify_add_watch(mInotify, mFileName.c_str(), IN_MODIFY | IN_CLOSE_WRITE | IN_MOVE_SELF | IN_DELETE_SELF | IN_ATTRIB);
+	if (mFileWatch == -1) {
+		LPLOG("'%s' not available yet (err %d)", mFileName.c_str(), errno);
+		return;
+	}
+	// The document reads the rest of the moved file when it finds the new one, and then closes it
+	if (mMovedWatch != -1 && mMovedWatch != mFileWatch)
+		inotify_rm_watch(mInotify, mMovedWatch);
+	mMovedWatch = -1;
+#endif
+}
+
+gboolean FileWatcher::NotificationCB(GIOChannel *, GIOCondition, gpointer data) {
+	((FileWatcher *)data)->Notification();
+	return true;
+}
+
+void FileWatcher::Notification() {
+#ifdef __linux__
+	std::string baseName = mFileName.substr(mFileName.rfind('/') + 1);
+	bool changed = false;
+	alignas(struct inotify_event) char buff[4096];
+	for (;;) {
+		ssize_t len = read(mInotify, buff, sizeof buff);
+		if (len <= 0)
+			break; // EAGAIN, all events consumed
+		for (char *p = buff; p < buff + len; ) {
+			const struct inotify_event *ev = (const struct inotify_event *)p;
+			p += sizeof(struct inotify_event) + ev->len;
+			if (ev->wd == mDirWatch) {
+				if (ev->len > 0 && baseName == ev->name) {
+					LPLOG("'%s' created", ev->name);
+					AddFileWatch();
+					changed = true;
+				}
+			} else if (ev->wd == mFileWatch) {
+				if (ev->mask & IN_MOVE_SELF) {
+					LPLOG("'%s' moved", mFileName.c_str());
+					// Lines may still be added to the moved file, and are read until there is a new one
+					if (mMovedWatch != -1)
+						inotify_rm_watch(mInotify, mMovedWatch);
+					mMovedWatch = mFileWatch;
+					mFileWatch = -1;
+					AddFileWatch(); // Follow the name, not the old file
+				} else if (ev->mask & (IN_DELETE_SELF | IN_IGNORED)) {
+					LPLOG("'%s' deleted (0x%x)", mFileName.c_str(), ev->mask);
+					AddFileWatch(); // Follow the name, not the old file
+				}
+				changed = true;
+			} else if (ev->wd == mMovedWatch) {
+				if (ev->mask & (IN_DELETE_SELF | IN_IGNORED))
+					mMovedWatch = -1;
+				changed = true;
+			}
+		}
+	}
+	if (changed)
+		Schedule(cCoalescePeriod);
+#endif
+}
@@ -0,0 +1,65 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <gtk/gtk.h>
+#include <string>
+#include <functional>
+
+// Call a function when a file may have changed.
+// Notifications from inotify are used when possible, integrated into the main loop. Otherwise,
+// e.g. for network file systems, the file is polled with a period that backs off while the
+// file is quiet.
+class FileWatcher
+{
+public:
+	// The callback shall return true if there was new data, which is used to adapt the polling period.
+	typedef std::function<bool ()> Callback;
+	FileWatcher() = default;
+	~FileWatcher() { Stop(); }
+	void Start(const std::string &fileName, Callback, unsigned maxPollPeriod);
+	void Stop();
+	bool UsingNotification() const { return mInotify != -1; }
+
+private:
+	static const unsigned cMinPollPeriod = 50;   // ms
+	static const unsigned cCoalescePeriod = 10;  // ms, collect bursts of notifications into one callback
+	std::string mFileName;
+	Callback mCallback;
+	bool mActive = false;
+	unsigned mPollPeriod = cMinPollPeriod;
+	unsigned mMaxPollPeriod = 1000;
+	guint mTimer = 0;
+
+	int mInotify = -1;
+	int mFileWatch = -1;
+	int mMovedWatch = -1; // The file moved away from the name, which is still written until a new file has the name
+	int mDirWatch = -1;
+	GIOChannel *mChannel = nullptr;
+	guint mIoSource = 0;
+
+	bool StartNotification();
+	void StopNotification();
+	void AddFileWatch();
+	void Schedule(unsigned ms);
+	static gboolean NotificationCB(GIOChannel *, GIOCondition, gpointer);
+	static gboolean TimerCB(gpointer);
+	void Notification();
+	void Timer();
+
+	FileWatcher(const FileWatcher &) = delete;
+	FileWatcher &operator=(const FileWatcher &) = delete;
+};
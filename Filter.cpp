@@ -0,0 +1,252 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <glib.h>
+
+#include "Filter.h"
+#include "Regex.h"
+
+void Filter::Clear() {
+	mNodes.clear();
+	mChildren.clear();
+	mStats.clear();
+	mStrings.Clear();
+	mRanges.clear();
+	mOpen.clear();
+}
+
+void Filter::Begin(const char *pattern, bool active) {
+	Node node = { Op::Neither, 0, 0, 0, 0 };
+	Range range;
+	if (!active || pattern == nullptr) {
+	} else if (strcmp(pattern, "|") == 0) {
+		node.op = Op::Or;
+	} else if (strcmp(pattern, "&") == 0) {
+		node.op = Op::And;
+	} else if (strcmp(pattern, "!") == 0) {
+		node.op = Op::Not;
+	} else if (*pattern == 0) {
+		node.op = Op::Always;
+	} else if (*pattern == '@' && ParseRange(pattern + 1, &range)) {
+		node.op = Op::TimeRange;
+		node.needle = mRanges.size();
+		mRanges.push_back(range);
+	} else {
+		node.op = Op::Contains;
+		node.needle = mStrings.Add(pattern);
+	}
+	mOpen.push_back(mNodes.size());
+	mNodes.push_back(node);
+}
+
+void Filter::End() {
+	g_assert(!mOpen.empty());
+	unsigned index = mOpen.back();
+	mOpen.pop_back();
+	Node &node = mNodes[index];
+	node.end = mNodes.size();
+	if (node.end == index + 1 && (node.op == Op::Or || node.op == Op::And || node.op == Op::Not)) {
+		// An operator without children is an ordinary string
+		const char *str = node.op == Op::Or ? "|" : node.op == Op::And ? "&" : "!";
+		node.op = Op::Contains;
+		node.needle = mStrings.Add(str);
+	}
+	if (node.op == Op::Or || node.op == Op::And) {
+		node.firstChild = mChildren.size();
+		for (unsigned child = index + 1; child < node.end; child = mNodes[child].end) {
+			mChildren.push_back(child);
+			node.numChildren++;
+		}
+	}
+	if (mOpen.empty())
+		mStrings.Prepare(); // The tree is complete
+}
+
+void Filter::Parse(const std::string &str) {
+	this->Clear();
+	this->ParseNode(str);
+	g_assert(mOpen.empty());
+}
+
+// The same syntax as View::DeSerialize(), one out of 4 possible patterns:
+// s
+// s(...)
+// s,
+// s)
+std::string::size_type Filter::ParseNode(const std::string &str) {
+	// A regular expression may contain the characters used for the tree
+	auto regexEnd = Regex::End(str);
+	auto from = regexEnd == std::string::npos ? 0 : regexEnd;
+	auto opening = str.find('(', from);
+	auto closing = str.find(')', from);
+	auto comma = str.find(',', from);
+	auto stopper = std::min(std::min(comma, str.size()), std::min(closing, opening));
+	this->Begin(str.substr(0, stopper).c_str(), true);
+	if (opening > stopper) {
+		this->End();
+		return stopper;
+	}
+	std::string::size_type next = opening+1;
+	do {
+		// There is at least one child
+		next += this->ParseNode(str.substr(next));
+		if (next < str.size() && str[next] == ',')
+			next++;
+	} while (next < str.size() && str[next] != ')');
+	this->End();
+	return std::min(next+1, str.size()); // Skipping parenthesis
+}
+
+bool Filter::ParseRange(const std::string &str, Range *range) {
+	auto dots = str.find("..");
+	if (dots == std::string::npos || str.size() == 2)
+		return false;
+	std::string from = str.substr(0, dots), to = str.substr(dots + 2);
+	Timestamp::Time unit;
+	bool fromTimeOfDay = true, toTimeOfDay = true;
+	if (!from.empty() && !Timestamp::ParseUser(from, &range->from, &unit, &fromTimeOfDay))
+		return false;
+	if (!to.empty() && !Timestamp::ParseUser(to, &range->to, &unit, &toTimeOfDay))
+		return false;
+	if (from.empty())
+		range->from = toTimeOfDay ? 0 : Timestamp::cNone;
+	if (to.empty())
+		range->to = fromTimeOfDay ? Timestamp::cDay : Timestamp::cMax;
+	else if (!fromTimeOfDay && toTimeOfDay)
+		range->to += Timestamp::Day(range->from) * Timestamp::cDay; // The same day
+	else if (fromTimeOfDay && !toTimeOfDay && !from.empty())
+		range->from += Timestamp::Day(range->to) * Timestamp::cDay;
+	if (!to.empty())
+		range->to += unit; // All of the last field
+	range->timeOfDay = fromTimeOfDay && toTimeOfDay;
+	return true;
+}
+
+LineSet Filter::Select(const std::vector<const LineSet *> &strings, const TimeIndex &times, unsigned first, unsigned last,
+					   Profile *profile, const std::vector<double> *searchTime) const {
+	g_assert(mOpen.empty() && strings.size() == mStrings.size());
+	if (profile != nullptr) {
+		profile->resize(mNodes.size());
+		if (searchTime != nullptr) {
+			// The time to find a string belongs to the leaf, and to all nodes above it
+			for (unsigned i = 0; i < mNodes.size(); i++) {
+				if (mNodes[i].op != Op::Contains)
+					continue;
+				for (unsigned parent = 0; parent <= i; parent++) {
+					if (mNodes[parent].end > i && mNodes[parent].op != Op::Neither)
+						(*profile)[parent].seconds += (*searchTime)[mNodes[i].needle];
+				}
+			}
+		}
+	}
+	mStats.resize(mNodes.size());
+	LineSet lines;
+	bool found = !mNodes.empty() && Select(0, strings, times, first, last, lines, profile);
+	this->Reorder();
+	if (!found)
+		return LineSet::Range(first, last); // Neither, everything is shown
+	return lines;
+}
+
+// Add the cost of a node to 'profile', if there is one.
+bool Filter::Select(unsigned index, const std::vector<const LineSet *> &strings, const TimeIndex &times, unsigned first, unsigned last, LineSet &lines, Profile *profile) const {
+	if (profile == nullptr || mNodes[index].op == Op::Neither)
+		return SelectNode(index, strings, times, first, last, lines, profile);
+	auto start = std::chrono::steady_clock::now();
+	NodeProfile &p = (*profile)[index];
+	bool found = SelectNode(index, strings, times, first, last, lines, profile);
+	p.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	p.lines += last - first;
+	if (found)
+		p.matches += lines.Count(first, last);
+	return found;
+}
+
+// A leaf is never Neither for any line. It follows that a node is either Neither for all lines,
+// or it is Match for some lines and Nomatch for the rest.
+bool Filter::SelectNode(unsigned index, const std::vector<const LineSet *> &strings, const TimeIndex &times, unsigned first, unsigned last, LineSet &lines, Profile *profile) const {
+	const Node &node = mNodes[index];
+	bool found = false;
+	switch (node.op) {
+	case Op::Or:
+	case Op::And:
+		for (unsigned i = node.firstChild; i < node.firstChild + node.numChildren; i++) {
+			unsigned child = mChildren[i];
+			LineSet current;
+			if (!Select(child, strings, times, first, last, current, profile))
+				continue;
+			this->Record(child, last - first, current.Count(first, last));
+			if (!found)
+				lines = std::move(current);
+			else if (node.op == Op::Or)
+				lines = lines.Union(current);
+			else
+				lines = lines.Intersection(current);
+			found = true;
+			if (node.op == Op::And && lines.Empty())
+				break; // Nothing left for the other children to remove
+		}
+		return found;
+	case Op::Not:
+		if (!Select(index + 1, strings, times, first, last, lines, profile))
+			return false;
+		lines = lines.Complement(first, last);
+		return true;
+	case Op::Contains:
+		lines = strings[node.needle]->Tail(first);
+		return true;
+	case Op::Always:
+		lines = LineSet::Range(first, last);
+		return true;
+	case Op::TimeRange: {
+		const Range &range = mRanges[node.needle];
+		lines = times.Select(range.from, range.to, range.timeOfDay, first, last);
+		return true;
+	}
+	case Op::Neither:
+		break;
+	}
+	return false;
+}
+
+void Filter::Record(unsigned index, unsigned lines, unsigned matches) const {
+	Stats &stats = mStats[index];
+	stats.lines += lines;
+	stats.matches += matches;
+	while (stats.lines > cStatsLines) {
+		stats.lines /= 2;
+		stats.matches /= 2;
+	}
+}
+
+void Filter::Reorder() const {
+	// A child that is not known well enough, or not active, is assumed to match half of the lines
+	auto Selectivity = [this](unsigned node) {
+		const Stats &stats = mStats[node];
+		return stats.lines < cMinStatsLines ? 0.5 : stats.matches / stats.lines;
+	};
+	for (auto &node : mNodes) {
+		auto begin = mChildren.begin() + node.firstChild;
+		auto end = begin + node.numChildren;
+		if (node.op == Op::And)
+			std::stable_sort(begin, end, [&](unsigned a, unsigned b) { return Selectivity(a) < Selectivity(b); });
+		else if (node.op == Op::Or)
+			std::stable_sort(begin, end, [&](unsigned a, unsigned b) { return Selectivity(a) > Selectivity(b); });
+	}
+}
@@ -0,0 +1,110 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "StringSearch.h"
+#include "LineSet.h"
+#include "TimeIndex.h"
+
+// The pattern tree compiled into a form that is cheap to evaluate for all lines, with the lines of every string.
+// Nodes are stored in pre-order in one array, where every node knows where its sub tree ends.
+// The siblings of a node are thus found without any pointers, and nothing depends on GTK.
+// When there are many search strings, the document searches for all of them in one pass over every line.
+// A pattern written as "/.../" is a regular expression, compiled once when the node is added.
+// A pattern written as "@FROM..TO" is a range of time, e.g. "@14:02..14:05" or "@2024-01-01 14:00..", see
+// Timestamp::ParseUser(). TO includes all of the last field given. A time of day selects the lines of every day,
+// unless the other end of the range has a date. The lines are found by a binary search in the times of the document.
+// The children of And and Or are tested in the order most likely to decide the result early: the fewest matches
+// first for And, and the most matches first for Or. The order is learned from the lines selected, and changes
+// as they do, but the result doesn't depend on it. The tree itself keeps the order it was given.
+class Filter
+{
+public:
+	// What a node has cost so far, accumulated over calls of Select(). Nodes that are not active are not counted.
+	struct NodeProfile {
+		uint64_t lines = 0;   // Lines the node was evaluated for
+		uint64_t matches = 0; // Lines that matched
+		double seconds = 0;   // Time used by the node and its sub tree, including searching for the strings
+	};
+	typedef std::vector<NodeProfile> Profile; // Indexed the same way as the nodes, in pre-order
+
+	void Clear();
+	// Add a node, in pre-order. Every call shall be matched by a call to End(), after the children are added.
+	// A node that is not active evaluates to Neither, as do all its children.
+	void Begin(const char *pattern, bool active);
+	void End();
+	// Build the tree from the format patterns are saved in, e.g. "|(error,&(warning,!(debug)))", with all nodes active.
+	void Parse(const std::string &);
+
+	unsigned size() const { return mNodes.size(); }
+
+	// The strings searched for by the filter
+	const StringSearch &Strings() const { return mStrings; }
+	// The lines that are shown, given the lines that contain each string and the times of the lines. The result is
+	// valid from 'first' to 'last'. A line is shown unless the tree evaluates to no match for it.
+	// If 'profile' is given, the cost is added to it. 'searchTime' is then the time used to find each string.
+	LineSet Select(const std::vector<const LineSet *> &strings, const TimeIndex &times, unsigned first, unsigned last,
+				   Profile *profile = nullptr, const std::vector<double> *searchTime = nullptr) const;
+
+private:
+	enum class Op : uint8_t {
+		Or,
+		And,
+		Not,
+		Contains,
+		Always,  // Empty string, matches everything
+		TimeRange,
+		Neither, // Not active
+	};
+	struct Node {
+		Op op;
+		unsigned end;    // Index of the node following the sub tree
+		unsigned needle; // Index into mStrings, for Contains, or into mRanges, for TimeRange
+		unsigned firstChild, numChildren; // The children in mChildren, for Or and And
+	};
+	std::vector<Node> mNodes;
+	struct Range {
+		Timestamp::Time from, to; // 'to' is not included, see TimeIndex::Select()
+		bool timeOfDay;
+	};
+	std::vector<Range> mRanges;
+	static bool ParseRange(const std::string &, Range *); // Without the '@'
+	// The children of every Or and And node, in the order they are tested
+	mutable std::vector<unsigned> mChildren;
+	// How often every node matched, for the lines selected recently
+	struct Stats {
+		double lines = 0;
+		double matches = 0;
+	};
+	mutable std::vector<Stats> mStats;
+	static const unsigned cStatsLines = 1000000; // Old lines count less when there are more than this
+	static const unsigned cMinStatsLines = 1000; // Too few lines to say what node is better
+	void Record(unsigned node, unsigned lines, unsigned matches) const;
+	void Reorder() const; // Sort the children using mStats
+	StringSearch mStrings;
+	std::vector<unsigned> mOpen; // Nodes that have no End() yet
+	std::string::size_type ParseNode(const std::string &); // Return the number of characters used
+
+	// Return false if the result is Neither. Otherwise, 'lines' are the lines that match. The order of the
+	// children is updated, and is thus not safe to use from more than one thread.
+	// Select() adds the cost to the profile, if there is one, and SelectNode() does the work.
+	bool Select(unsigned node, const std::vector<const LineSet *> &, const TimeIndex &, unsigned first, unsigned last, LineSet &lines, Profile *) const;
+	bool SelectNode(unsigned node, const std::vector<const LineSet *> &, const TimeIndex &, unsigned first, unsigned last, LineSet &lines, Profile *) const;
+};
@@ -0,0 +1,194 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <cstring>
+#include <cstdint>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LPLOG_X86
+#include <immintrin.h>
+#endif
+
+#include "Finder.h"
+#include "Regex.h"
+
+// Candidates are positions where both the first and the last character of the needle match,
+// which are then compared in full. A byte 'c' matches a folded letter 'n' when (c | 0x20) == n.
+namespace {
+
+enum class Isa {
+	Scalar,
+	SSE2,
+	AVX2,
+};
+
+Isa Detect() {
+#ifdef LPLOG_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return Isa::AVX2;
+#ifdef __SSE2__
+	return Isa::SSE2;
+#endif
+#endif
+	return Isa::Scalar;
+}
+
+const Isa sIsa = Detect();
+
+} // namespace
+
+const size_t Finder::npos;
+
+Finder::Finder(const std::string &str, bool caseSensitive, bool literal) : mString(str), mNeedle(str), mFold(str.size(), 0), mCaseSensitive(caseSensitive) {
+	if (!literal && Regex::IsRegex(str)) {
+		auto regex = std::make_shared<Regex>(str, caseSensitive);
+		if (regex->Valid())
+			mRegex = regex; // Otherwise, the string is searched for as it is
+	}
+	if (caseSensitive)
+		return;
+	for (size_t i = 0; i < mNeedle.size(); i++) {
+		char c = mNeedle[i];
+		if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')) {
+			mNeedle[i] = c | 0x20;
+			mFold[i] = 0x20;
+		}
+	}
+}
+
+const char *Finder::Implementation() {
+	switch (sIsa) {
+	case Isa::AVX2:
+		return "AVX2";
+	case Isa::SSE2:
+		return "SSE2";
+	case Isa::Scalar:
+		break;
+	}
+	return "scalar";
+}
+
+bool Finder::Equal(const char *p, size_t from, size_t to) const {
+	for (size_t i = from; i < to; i++) {
+		if ((p[i] | mFold[i]) != mNeedle[i])
+			return false;
+	}
+	return true;
+}
+
+bool Finder::Includes(const Finder &other) const {
+	if (mCaseSensitive != other.mCaseSensitive)
+		return false;
+	if (mRegex != nullptr || other.mRegex != nullptr)
+		return mString == other.mString;
+	return mNeedle.find(other.mNeedle) != std::string::npos;
+}
+
+size_t Finder::Find(const char *p, size_t size, size_t *length) const {
+	if (mRegex != nullptr) {
+		size_t start;
+		return mRegex->Match(p, size, &start, length) ? start : npos;
+	}
+	size_t len = mNeedle.size();
+	if (length != nullptr)
+		*length = len;
+	if (len == 0)
+		return 0;
+	if (len > size)
+		return npos;
+	switch (sIsa) {
+#ifdef LPLOG_X86
+	case Isa::AVX2:
+		return FindAVX2(p, size);
+#ifdef __SSE2__
+	case Isa::SSE2:
+		return FindSSE2(p, size);
+#endif
+#endif
+	default:
+		return FindScalar(p, size, 0);
+	}
+}
+
+size_t Finder::Find(const char *p, size_t size, size_t *length, size_t from) const {
+	if (from > size)
+		return npos;
+	if (mRegex != nullptr) {
+		size_t start;
+		return mRegex->Match(p, size, &start, length, from) ? start : npos;
+	}
+	size_t found = this->Find(p + from, size - from, length);
+	return found == npos ? npos : from + found;
+}
+
+size_t Finder::FindScalar(const char *p, size_t size, size_t start) const {
+	size_t len = mNeedle.size();
+	char first = mNeedle[0], fold = mFold[0];
+	for (size_t i = start; i + len <= size; i++) {
+		if ((p[i] | fold) == first && Equal(p + i, 1, len))
+			return i;
+	}
+	return npos;
+}
+
+#if defined(LPLOG_X86) && defined(__SSE2__)
+size_t Finder::FindSSE2(const char *p, size_t size) const {
+	size_t len = mNeedle.size();
+	const __m128i first = _mm_set1_epi8(mNeedle[0]), firstFold = _mm_set1_epi8(mFold[0]);
+	const __m128i last = _mm_set1_epi8(mNeedle[len-1]), lastFold = _mm_set1_epi8(mFold[len-1]);
+	size_t i = 0;
+	for (; i + len - 1 + 16 <= size; i += 16) {
+		__m128i a = _mm_or_si128(_mm_loadu_si128((const __m128i *)(p + i)), firstFold);
+		__m128i b = _mm_or_si128(_mm_loadu_si128((const __m128i *)(p + i + len - 1)), lastFold);
+		unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+		for (; mask != 0; mask &= mask - 1) {
+			size_t pos = i + __builtin_ctz(mask);
+			if (Equal(p + pos, 1, len - 1))
+				return pos;
+		}
+	}
+	return FindScalar(p, size, i);
+}
+#else
+size_t Finder::FindSSE2(const char *p, size_t size) const {
+	return FindScalar(p, size, 0);
+}
+#endif
+
+#ifdef LPLOG_X86
+__attribute__((target("avx2")))
+size_t Finder::FindAVX2(const char *p, size_t size) const {
+	size_t len = mNeedle.size();
+	const __m256i first = _mm256_set1_epi8(mNeedle[0]), firstFold = _mm256_set1_epi8(mFold[0]);
+	const __m256i last = _mm256_set1_epi8(mNeedle[len-1]), lastFold = _mm256_set1_epi8(mFold[len-1]);
+	size_t i = 0;
+	for (; i + len - 1 + 32 <= size; i += 32) {
+		__m256i a = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(p + i)), firstFold);
+		__m256i b = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(p + i + len - 1)), lastFold);
+		unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+		for (; mask != 0; mask &= mask - 1) {
+			size_t pos = i + __builtin_ctz(mask);
+			if (Equal(p + pos, 1, len - 1))
+				return pos;
+		}
+	}
+	return FindScalar(p, size, i);
+}
+#else
+size_t Finder::FindAVX2(const char *p, size_t size) const {
+	return FindScalar(p, size, 0);
+}
+#endif
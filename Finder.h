@@ -0,0 +1,61 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <string>
+#include <cstddef>
+#include <memory>
+
+#include "LineStore.h"
+
+class Regex;
+
+// Search for a string, as done by "find".
+// If not case sensitive, ASCII letters are folded while comparing, there is no lower case copy of the text.
+// A vectorized version (AVX2 or SSE2) is selected at runtime, with a scalar fallback.
+// A string written as "/.../" is a regular expression, unless 'literal'.
+class Finder
+{
+public:
+	Finder() = default;
+	Finder(const std::string &, bool caseSensitive, bool literal = false);
+	static const size_t npos = ~size_t(0);
+	// Return the offset of the first match, or npos. The size of the match is returned in '*length', if given.
+	size_t Find(const char *, size_t size, size_t *length = nullptr) const;
+	// As above, but the search starts at 'from', and the offset is from the beginning of the text.
+	// Use this to find the next match in a line, as a regular expression has to see the whole line.
+	size_t Find(const char *, size_t size, size_t *length, size_t from) const;
+	size_t Find(const LineRef &line, size_t *length = nullptr) const { return Find(line.data, line.size, length); }
+	const std::string &str() const { return mString; }
+	bool CaseSensitive() const { return mCaseSensitive; }
+	// True if a text that contains this string always contains the string of the other
+	bool Includes(const Finder &other) const;
+
+	// Return the name of the implementation in use
+	static const char *Implementation();
+
+private:
+	std::string mString;
+	std::string mNeedle;  // Lower case, if not case sensitive
+	std::string mFold;    // 0x20 for every letter that shall be folded, otherwise 0
+	bool mCaseSensitive = true;
+	std::shared_ptr<Regex> mRegex;
+
+	bool Equal(const char *, size_t from, size_t to) const; // Compare a part of the needle
+	size_t FindScalar(const char *, size_t size, size_t start) const;
+	size_t FindSSE2(const char *, size_t size) const;
+	size_t FindAVX2(const char *, size_t size) const;
+};
@@ -0,0 +1,164 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <thread>
+#include <chrono>
+#include <sys/stat.h>
+
+#include "Headless.h"
+#include "Document.h"
+#include "SaveFile.h"
+#include "Debug.h"
+
+bool Headless::Requested(int argc, char *argv[]) {
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--filter") == 0 || strcmp(argv[i], "--pattern") == 0)
+			return true;
+	}
+	return false;
+}
+
+void Headless::Usage() {
+	std::fprintf(stderr,
+		"Usage: lplog --filter EXPR [-f] [-n] [-d] FILE...\n"
+		"       lplog --pattern NAME [-f] [-n] [-d] FILE...\n"
+		"  --filter EXPR   Filter in the saved format, e.g. '|(error,&(warning,!(debug)))'\n"
+		"  --pattern NAME  Use a pattern saved from the window\n"
+		"  -f              Follow the file as it grows, also when it is rotated or truncated\n"
+		"  -n              Show line numbers\n"
+		"  -d              Ignore duplicate lines\n"
+		"Several files, or a pattern like 'logs/*.log', are merged in the order of the time stamps of the lines.\n");
+}
+
+bool Headless::ParseArguments(int argc, char *argv[]) {
+	std::string pattern;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if ((arg == "--filter" || arg == "--pattern") && i+1 < argc) {
+			pattern = argv[++i];
+			if (arg == "--pattern") {
+				std::string name = pattern;
+				pattern = mSaveFile.GetPattern(name);
+				if (pattern.empty()) {
+					std::fprintf(stderr, "lplog: there is no pattern '%s'\n", name.c_str());
+					return false;
+				}
+			}
+		} else if (arg == "-f") {
+			mFollow = true;
+		} else if (arg == "-n") {
+			mLineNumbers = true;
+		} else if (arg == "-d") {
+			mIgnoreDuplicateLines = true;
+		} else if (arg[0] != '-') {
+			for (auto &fileName : Document::MatchFileNames(arg))
+				mFileNames.push_back(fileName);
+		} else {
+			return false;
+		}
+	}
+	if (mFileNames.empty())
+		return false;
+	LPLOG("'%s' pattern '%s'", mFileNames[0].c_str(), pattern.c_str());
+	mFilter.Parse(pattern);
+	return true;
+}
+
+int Headless::Run(int argc, char *argv[]) {
+	if (!this->ParseArguments(argc, argv)) {
+		Usage();
+		return 2;
+	}
+	for (auto &fileName : mFileNames) {
+		struct stat st;
+		if (stat(fileName.c_str(), &st) != 0) {
+			std::fprintf(stderr, "lplog: %s: %s\n", fileName.c_str(), strerror(errno));
+			return 2;
+		}
+	}
+	for (bool replaced = true; replaced; ) {
+		Document doc;
+		doc.SetFollow(mFollow);
+		doc.SetRetention(mSaveFile.GetIntOption("MaxLines", 0), uint64_t(mSaveFile.GetIntOption("MaxMegabytes", 0)) * 1024 * 1024);
+		doc.SetTimestamp(Timestamp(mSaveFile.GetStringOption("TimestampFormat", Timestamp::cDefaultFormat)));
+		if (mFileNames.size() > 1)
+			doc.AddSourceFiles(mFileNames);
+		else
+			doc.AddSourceFile(mFileNames[0]);
+		replaced = this->Follow(&doc);
+		mPrevLine.clear();
+	}
+	std::fflush(stdout);
+	return mLinesWritten > 0 ? 0 : 1;
+}
+
+// Return true if the file was replaced, and shall be read again from the beginning
+bool Headless::Follow(Document *doc) {
+	for (;;) {
+		switch (doc->UpdateInputData()) {
+		case Document::UpdateResult::Grow:
+			this->Output(doc);
+			doc->Evict(); // The lines are written, and only the same as in the window are kept
+			break;
+		case Document::UpdateResult::Prepended:
+			break; // Not used, the file is read from the start
+		case Document::UpdateResult::Changed:
+			break; // The lines were already written
+		case Document::UpdateResult::Replaced:
+			doc->StopUpdate();
+			return mFollow;
+		case Document::UpdateResult::NoChange:
+			if (doc->Loading()) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				break;
+			}
+			if (!mFollow)
+				return false;
+			std::fflush(stdout);
+			std::this_thread::sleep_for(std::chrono::milliseconds(cFollowPeriod));
+			doc->RequestUpdate();
+			break;
+		}
+	}
+}
+
+// The same selection of lines as View::FilterLines()
+void Headless::Output(Document *doc) {
+	LineSet shown = doc->Select(mFilter, mPool, false);
+	LineRef prevLine = { mPrevLine.data(), unsigned(mPrevLine.size()) };
+	auto WriteLine = [&] (const LineRef &str, unsigned line) {
+		if (!shown.Contains(line))
+			return false;
+		if (mIgnoreDuplicateLines) {
+			if (str == prevLine)
+				return false;
+			prevLine = str;
+		}
+		if (mLineNumbers)
+			std::printf("%u\t", line+1);
+		if (doc->Merged())
+			std::printf("%s\t", doc->GetSourceName(line).c_str());
+		std::fwrite(str.data, 1, str.size, stdout);
+		std::putchar('\n');
+		mLinesWritten++;
+		return false; // There is no view that needs the lines
+	};
+	doc->IterateLines(WriteLine, false);
+	mPrevLine.assign(prevLine.data, prevLine.size);
+}
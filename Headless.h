@@ -0,0 +1,54 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "ThreadPool.h"
+#include "Filter.h"
+
+class SaveFile;
+class Document;
+
+// Filter a file without any window, and write the lines that are shown to stdout, e.g.
+//   lplog --filter '&(error,!(debug))' -n app.log | less
+// The same Document and Filter are used as in the window, which makes it useful also for measuring them.
+class Headless
+{
+public:
+	Headless(SaveFile &save) : mSaveFile(save) {}
+	static bool Requested(int argc, char *argv[]); // True if the arguments ask for this mode
+	int Run(int argc, char *argv[]);               // Return the exit status, as grep does
+
+private:
+	static const unsigned cFollowPeriod = 100; // ms, how often the file is checked when following it
+	SaveFile &mSaveFile;
+	std::vector<std::string> mFileNames; // More than one are merged
+	bool mFollow = false;
+	bool mLineNumbers = false;
+	bool mIgnoreDuplicateLines = false;
+	std::string mPrevLine; // The last line written, to find duplicates
+	unsigned mLinesWritten = 0;
+	ThreadPool mPool;
+	Filter mFilter;
+
+	bool ParseArguments(int argc, char *argv[]); // Return false if they are not valid
+	static void Usage();
+	bool Follow(Document *); // Read the file until it is done, or replaced
+	void Output(Document *); // Write the new lines that are shown
+};
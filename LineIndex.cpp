@@ -0,0 +1,181 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "LineIndex.h"
+#include "Debug.h"
+
+const char LineIndex::cMagic[8] = { 'L', 'P', 'L', 'O', 'G', 'I', 'D', 'X' };
+
+bool LineIndex::Fingerprint::operator==(const Fingerprint &other) const {
+	return device == other.device && inode == other.inode && testSize == other.testSize && testHash == other.testHash;
+}
+
+// FNV-1a, 64 bits
+uint64_t LineIndex::Hash(const char *p, unsigned size) {
+	uint64_t hash = 14695981039346656037ull;
+	for (unsigned i = 0; i < size; i++) {
+		hash ^= (unsigned char)p[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+void LineIndex::Clear() {
+	mCheckpoints.clear();
+	mData.clear();
+	mNumLines = 0;
+	mEnd = 0;
+	mPosition = 0;
+}
+
+// Unsigned LEB128, 7 bits in every byte
+void LineIndex::Put(uint64_t value) {
+	while (value >= 0x80) {
+		mData += char(value | 0x80);
+		value >>= 7;
+	}
+	mData += char(value);
+}
+
+void LineIndex::Add(uint64_t pos, unsigned size, bool owned) {
+	// Usually only a newline is between the lines
+	this->Put(pos - mEnd);
+	this->Put(uint64_t(size) << 1 | owned);
+	mEnd = pos + size;
+	if (++mNumLines % cCheckpointLines == 0)
+		mCheckpoints.push_back(mEnd);
+}
+
+void LineIndex::Append(const LineIndex &other) {
+	other.ForEach([this](uint64_t pos, unsigned size, bool owned) { this->Add(pos, size, owned); return true; });
+	mPosition = other.mPosition;
+}
+
+void LineIndex::ForEach(std::function<bool (uint64_t pos, unsigned size, bool owned)> f) const {
+	const unsigned char *p = (const unsigned char *)mData.data(), *end = p + mData.size();
+	auto Get = [&p, end]() {
+		uint64_t value = 0;
+		for (unsigned shift = 0; p < end && shift < 64; shift += 7) {
+			value |= uint64_t(*p & 0x7f) << shift;
+			if ((*p++ & 0x80) == 0)
+				break;
+		}
+		return value;
+	};
+	uint64_t pos = 0;
+	for (unsigned line = 0; line < mNumLines; line++) {
+		pos += Get();
+		uint64_t sizeOwned = Get();
+		if (!f(pos, unsigned(sizeOwned >> 1), sizeOwned & 1))
+			return;
+		pos += sizeOwned >> 1;
+	}
+}
+
+std::string LineIndex::PathFor(const std::string &fileName) {
+	std::string dir = std::string(g_get_user_cache_dir()) + G_DIR_SEPARATOR_S + "lplog";
+	g_mkdir_with_parents(dir.c_str(), 0700);
+	gchar *name = g_compute_checksum_for_string(G_CHECKSUM_SHA1, fileName.c_str(), -1);
+	std::string path = dir + G_DIR_SEPARATOR_S + name + ".idx";
+	g_free(name);
+	return path;
+}
+
+// The file is a header, the checkpoints and the encoded lines. Numbers are in the byte order of the machine,
+// as the index is only used where it was made.
+struct IndexHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t testSize;
+	uint64_t device, inode, testHash;
+	uint64_t numLines, end, position;
+	uint64_t numCheckpoints, dataSize;
+};
+
+bool LineIndex::Load(const std::string &fileName, const Fingerprint &fingerprint) {
+	this->Clear();
+	std::string path = PathFor(fileName);
+	std::ifstream input(path, std::ios::binary);
+	if (!input.is_open())
+		return false;
+	IndexHeader header;
+	if (!input.read((char *)&header, sizeof header) || memcmp(header.magic, cMagic, sizeof cMagic) != 0 || header.version != cVersion) {
+		LPLOG("'%s' is not an index", path.c_str());
+		return false;
+	}
+	Fingerprint saved;
+	saved.device = header.device;
+	saved.inode = header.inode;
+	saved.testSize = header.testSize;
+	saved.testHash = header.testHash;
+	if (!(saved == fingerprint)) {
+		LPLOG("'%s' is for another file", path.c_str());
+		return false;
+	}
+	mCheckpoints.resize(header.numCheckpoints);
+	mData.resize(header.dataSize);
+	if (!input.read((char *)mCheckpoints.data(), mCheckpoints.size() * sizeof mCheckpoints[0]) || !input.read(&mData[0], mData.size())) {
+		LPLOG("'%s' is truncated", path.c_str());
+		this->Clear();
+		return false;
+	}
+	mNumLines = header.numLines;
+	mEnd = header.end;
+	mPosition = header.position;
+	LPLOG("%u lines to position %llu from '%s'", mNumLines, (unsigned long long)mPosition, path.c_str());
+	return true;
+}
+
+bool LineIndex::Save(const std::string &fileName, const Fingerprint &fingerprint) const {
+	std::string path = PathFor(fileName);
+	IndexHeader header;
+	memcpy(header.magic, cMagic, sizeof cMagic);
+	header.version = cVersion;
+	header.testSize = fingerprint.testSize;
+	header.device = fingerprint.device;
+	header.inode = fingerprint.inode;
+	header.testHash = fingerprint.testHash;
+	header.numLines = mNumLines;
+	header.end = mEnd;
+	header.position = mPosition;
+	header.numCheckpoints = mCheckpoints.size();
+	header.dataSize = mData.size();
+	// Write a temporary file first, so there is never an index that is only partly written
+	std::string tmp = path + ".tmp";
+	{
+		std::ofstream output(tmp, std::ios::binary | std::ios::trunc);
+		output.write((const char *)&header, sizeof header);
+		output.write((const char *)mCheckpoints.data(), mCheckpoints.size() * sizeof mCheckpoints[0]);
+		output.write(mData.data(), mData.size());
+		if (!output) {
+			LPLOG("failed to write '%s'", tmp.c_str());
+			return false;
+		}
+	}
+	g_remove(path.c_str()); // Needed on Windows, where a file can't be renamed over another
+	if (g_rename(tmp.c_str(), path.c_str()) != 0) {
+		LPLOG("failed to rename '%s'", tmp.c_str());
+		return false;
+	}
+	LPLOG("%u lines to position %llu in '%s'", mNumLines, (unsigned long long)mPosition, path.c_str());
+	return true;
+}
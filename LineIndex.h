@@ -0,0 +1,68 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+// The lines of a file, saved in the cache directory to make the file quick to open again.
+// Every line is the span of bytes it came from in the file, which means lines that had to be changed,
+// e.g. to remove color escape sequences, can be made again from the file without splitting all of it.
+// The spans are encoded as variable length integers, a few bytes for a line. The index is only valid for the
+// file it was made from, which is checked with the fingerprint. A sparse table of line ends is also kept,
+// which makes it cheap to test that the content wasn't changed further into the file.
+class LineIndex
+{
+public:
+	struct Fingerprint {
+		uint64_t device = 0;
+		uint64_t inode = 0;
+		unsigned testSize = 0; // Bytes at the start of the file the hash is made from
+		uint64_t testHash = 0;
+		bool operator==(const Fingerprint &) const;
+	};
+	static uint64_t Hash(const char *, unsigned size);
+
+	void Clear();
+	void Add(uint64_t pos, unsigned size, bool owned); // The next line, 'owned' if it can't refer to the file
+	void Append(const LineIndex &); // Add the lines of another index, which follow the lines of this one
+	unsigned size() const { return mNumLines; }
+	uint64_t Position() const { return mPosition; } // The first byte in the file after the lines
+	void SetPosition(uint64_t pos) { mPosition = pos; }
+
+	// Load the index of 'fileName', if there is one and it matches 'fingerprint'. Return false if it can't be used.
+	bool Load(const std::string &fileName, const Fingerprint &);
+	bool Save(const std::string &fileName, const Fingerprint &) const;
+	// Call 'f' for every line, in order, until it returns false
+	void ForEach(std::function<bool (uint64_t pos, unsigned size, bool owned)> f) const;
+	// The end of a line for every cCheckpointLines lines, where the file has a newline
+	const std::vector<uint64_t> &Checkpoints() const { return mCheckpoints; }
+
+private:
+	static const char cMagic[8];
+	static const uint32_t cVersion = 1;
+	static const unsigned cCheckpointLines = 65536;
+	std::vector<uint64_t> mCheckpoints;
+	std::string mData;
+	unsigned mNumLines = 0;
+	uint64_t mEnd = 0;      // End of the last line, where the next line is expected to start
+	uint64_t mPosition = 0;
+	void Put(uint64_t);
+	static std::string PathFor(const std::string &fileName);
+};
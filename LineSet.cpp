@@ -0,0 +1,274 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include <algorithm>
+
+#include "LineSet.h"
+
+const unsigned LineSet::cMaxArray;
+
+void LineSet::Container::ToBitmap() {
+	if (!bits.empty())
+		return;
+	bits.assign(cWords, 0);
+	for (auto low : array)
+		bits[low / 64] |= uint64_t(1) << (low % 64);
+	array.clear();
+	array.shrink_to_fit();
+}
+
+void LineSet::Container::Optimize() {
+	if (bits.empty()) {
+		if (count > cMaxArray)
+			ToBitmap();
+		return;
+	}
+	if (count > cMaxArray)
+		return;
+	array.clear();
+	array.reserve(count);
+	for (unsigned w = 0; w < cWords; w++) {
+		for (uint64_t word = bits[w]; word != 0; word &= word - 1)
+			array.push_back(w * 64 + __builtin_ctzll(word));
+	}
+	bits.clear();
+	bits.shrink_to_fit();
+}
+
+bool LineSet::Container::Contains(uint16_t low) const {
+	if (bits.empty())
+		return std::binary_search(array.begin(), array.end(), low);
+	return (bits[low / 64] >> (low % 64)) & 1;
+}
+
+void LineSet::Add(unsigned line) {
+	unsigned key = line >> cBlockBits;
+	if (mContainers.empty() || mContainers.back().key != key) {
+		mContainers.emplace_back();
+		mContainers.back().key = key;
+	}
+	Container &c = mContainers.back();
+	uint16_t low = line & (cBlockSize - 1);
+	if (c.bits.empty()) {
+		c.array.push_back(low);
+		c.count++;
+		if (c.count > cMaxArray)
+			c.ToBitmap();
+		return;
+	}
+	if (!((c.bits[low / 64] >> (low % 64)) & 1))
+		c.count++;
+	c.bits[low / 64] |= uint64_t(1) << (low % 64);
+}
+
+const LineSet::Container *LineSet::Find(unsigned key) const {
+	auto it = std::lower_bound(mContainers.begin(), mContainers.end(), key, [](const Container &c, unsigned k) { return c.key < k; });
+	if (it == mContainers.end() || it->key != key)
+		return nullptr;
+	return &*it;
+}
+
+bool LineSet::Contains(unsigned line) const {
+	const Container *c = Find(line >> cBlockBits);
+	return c != nullptr && c->Contains(line & (cBlockSize - 1));
+}
+
+unsigned LineSet::size() const {
+	unsigned count = 0;
+	for (auto &c : mContainers)
+		count += c.count;
+	return count;
+}
+
+unsigned LineSet::Count(unsigned first, unsigned last) const {
+	unsigned count = 0;
+	for (auto &c : mContainers) {
+		uint64_t base = uint64_t(c.key) << cBlockBits;
+		if (base >= last)
+			break;
+		if (base + cBlockSize <= first)
+			continue;
+		if (base >= first && base + cBlockSize <= last) {
+			count += c.count;
+			continue;
+		}
+		// Only a part of the block, which can only happen for the first and the last block
+		unsigned from = std::max<uint64_t>(first, base) - base;
+		unsigned to = std::min<uint64_t>(last, base + cBlockSize) - base;
+		if (c.bits.empty()) {
+			count += std::lower_bound(c.array.begin(), c.array.end(), to) - std::lower_bound(c.array.begin(), c.array.end(), from);
+			continue;
+		}
+		for (unsigned i = from; i < to; i++)
+			count += (c.bits[i / 64] >> (i % 64)) & 1;
+	}
+	return count;
+}
+
+void LineSet::EraseBefore(unsigned line) {
+	auto it = std::lower_bound(mContainers.begin(), mContainers.end(), line >> cBlockBits,
+		[](const Container &c, unsigned key) { return c.key < key; });
+	mContainers.erase(mContainers.begin(), it);
+}
+
+size_t LineSet::MemoryUsage() const {
+	size_t size = mContainers.capacity() * sizeof(Container);
+	for (auto &c : mContainers)
+		size += c.array.capacity() * sizeof(uint16_t) + c.bits.capacity() * sizeof(uint64_t);
+	return size;
+}
+
+LineSet LineSet::Range(unsigned first, unsigned last) {
+	return LineSet().Complement(first, last);
+}
+
+LineSet LineSet::Tail(unsigned line) const {
+	LineSet ret;
+	for (auto &c : mContainers) {
+		if (c.key >= line >> cBlockBits)
+			ret.mContainers.push_back(c);
+	}
+	return ret;
+}
+
+void LineSet::Append(const LineSet &other) {
+	for (auto &c : other.mContainers) {
+		if (!mContainers.empty() && mContainers.back().key == c.key)
+			mContainers.back() = Union(mContainers.back(), c);
+		else
+			mContainers.push_back(c);
+	}
+}
+
+LineSet::Container LineSet::Union(const Container &a, const Container &b) {
+	Container ret;
+	ret.key = a.key;
+	if (a.bits.empty() && b.bits.empty()) {
+		ret.array.resize(a.array.size() + b.array.size());
+		auto end = std::set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), ret.array.begin());
+		ret.array.erase(end, ret.array.end());
+		ret.count = ret.array.size();
+		ret.Optimize();
+		return ret;
+	}
+	// At least one is a bitmap
+	const Container &bitmap = a.bits.empty() ? b : a;
+	const Container &other = a.bits.empty() ? a : b;
+	ret.bits = bitmap.bits;
+	if (other.bits.empty()) {
+		for (auto low : other.array)
+			ret.bits[low / 64] |= uint64_t(1) << (low % 64);
+	} else {
+		for (unsigned w = 0; w < cWords; w++)
+			ret.bits[w] |= other.bits[w];
+	}
+	for (auto word : ret.bits)
+		ret.count += __builtin_popcountll(word);
+	return ret;
+}
+
+LineSet::Container LineSet::Intersection(const Container &a, const Container &b) {
+	Container ret;
+	ret.key = a.key;
+	if (a.bits.empty() || b.bits.empty()) {
+		const Container &array = a.bits.empty() ? a : b;
+		const Container &other = a.bits.empty() ? b : a;
+		for (auto low : array.array) {
+			if (other.Contains(low))
+				ret.array.push_back(low);
+		}
+		ret.count = ret.array.size();
+		return ret;
+	}
+	ret.bits.resize(cWords);
+	for (unsigned w = 0; w < cWords; w++) {
+		ret.bits[w] = a.bits[w] & b.bits[w];
+		ret.count += __builtin_popcountll(ret.bits[w]);
+	}
+	ret.Optimize();
+	return ret;
+}
+
+LineSet LineSet::Union(const LineSet &other) const {
+	LineSet ret;
+	auto a = mContainers.begin(), b = other.mContainers.begin();
+	while (a != mContainers.end() || b != other.mContainers.end()) {
+		if (b == other.mContainers.end() || (a != mContainers.end() && a->key < b->key)) {
+			ret.mContainers.push_back(*a++);
+		} else if (a == mContainers.end() || b->key < a->key) {
+			ret.mContainers.push_back(*b++);
+		} else {
+			ret.mContainers.push_back(Union(*a++, *b++));
+		}
+	}
+	return ret;
+}
+
+LineSet LineSet::Intersection(const LineSet &other) const {
+	LineSet ret;
+	auto a = mContainers.begin(), b = other.mContainers.begin();
+	while (a != mContainers.end() && b != other.mContainers.end()) {
+		if (a->key < b->key) {
+			a++;
+		} else if (b->key < a->key) {
+			b++;
+		} else {
+			Container c = Intersection(*a++, *b++);
+			if (c.count > 0)
+				ret.mContainers.push_back(std::move(c));
+		}
+	}
+	return ret;
+}
+
+LineSet LineSet::Complement(unsigned first, unsigned last) const {
+	LineSet ret;
+	if (first >= last)
+		return ret;
+	for (unsigned key = first >> cBlockBits; key <= (last - 1) >> cBlockBits; key++) {
+		Container c;
+		c.key = key;
+		const Container *existing = Find(key);
+		if (existing != nullptr) {
+			c.bits = existing->bits;
+			c.array = existing->array;
+			c.ToBitmap();
+			for (auto &word : c.bits)
+				word = ~word;
+		} else {
+			c.bits.assign(cWords, ~uint64_t(0));
+		}
+		// Remove what is outside of the range
+		unsigned base = key << cBlockBits;
+		for (unsigned w = 0; w < cWords; w++) {
+			unsigned line = base + w * 64;
+			if (line + 64 <= first || line >= last) {
+				c.bits[w] = 0;
+			} else {
+				if (line < first)
+					c.bits[w] &= ~uint64_t(0) << (first - line);
+				if (line + 64 > last)
+					c.bits[w] &= ~uint64_t(0) >> (line + 64 - last);
+			}
+			c.count += __builtin_popcountll(c.bits[w]);
+		}
+		if (c.count == 0)
+			continue;
+		c.Optimize();
+		ret.mContainers.push_back(std::move(c));
+	}
+	return ret;
+}
@@ -0,0 +1,97 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// A compressed set of line numbers.
+// Lines are grouped in blocks of 65536, where each block that has any lines is a container. A container is
+// a sorted array of the lower 16 bits when there are few lines, otherwise a bitmap. This is the layout of
+// "roaring bitmaps", which makes both sparse and dense sets small, and set operations fast.
+class LineSet
+{
+public:
+	void Clear() { mContainers.clear(); }
+	void Add(unsigned line); // Lines have to be added in increasing order
+	bool Contains(unsigned line) const;
+	bool Empty() const { return mContainers.empty(); }
+	unsigned size() const; // Number of lines in the set
+	unsigned Count(unsigned first, unsigned last) const; // Number of lines from 'first' to 'last', not including 'last'
+	void EraseBefore(unsigned line); // Remove the lines before 'line', which is rounded down to the start of a block
+	size_t MemoryUsage() const;
+
+	// All lines from 'first' to 'last', not including 'last'.
+	static LineSet Range(unsigned first, unsigned last);
+	// Only the blocks that include 'line' and later.
+	LineSet Tail(unsigned line) const;
+	// Add the lines of 'other', where none is lower than the highest line in this set.
+	void Append(const LineSet &other);
+	LineSet Union(const LineSet &) const;
+	LineSet Intersection(const LineSet &) const;
+	// The lines from 'first' to 'last' that are not in this set.
+	LineSet Complement(unsigned first, unsigned last) const;
+
+	// Call f(line) for the lines of the set from 'first' to 'last', in increasing order.
+	template<typename F> void ForEach(unsigned first, unsigned last, F f) const;
+
+	static const unsigned cBlockBits = 16;
+	static const unsigned cBlockSize = 1 << cBlockBits; // Lines in a block
+
+private:
+	static const unsigned cWords = cBlockSize / 64;
+	static const unsigned cMaxArray = 4096; // A bitmap is smaller when there are more lines than this
+	struct Container {
+		unsigned key = 0;             // The line number shifted down cBlockBits
+		unsigned count = 0;
+		std::vector<uint16_t> array;  // Used if there are no bits
+		std::vector<uint64_t> bits;   // cWords long, if used
+		void ToBitmap();
+		void Optimize();              // Use the smallest representation
+		bool Contains(uint16_t) const;
+	};
+	std::vector<Container> mContainers; // Sorted by key
+
+	static Container Union(const Container &, const Container &);
+	static Container Intersection(const Container &, const Container &);
+	const Container *Find(unsigned key) const;
+};
+
+template<typename F> void LineSet::ForEach(unsigned first, unsigned last, F f) const {
+	for (auto &c : mContainers) {
+		unsigned base = c.key << cBlockBits;
+		if (base >= last)
+			break;
+		if (base + cBlockSize <= first)
+			continue;
+		if (c.bits.empty()) {
+			for (auto low : c.array) {
+				unsigned line = base + low;
+				if (line >= first && line < last)
+					f(line);
+			}
+			continue;
+		}
+		for (unsigned w = 0; w < cWords; w++) {
+			for (uint64_t word = c.bits[w]; word != 0; word &= word - 1) {
+				unsigned line = base + w * 64 + __builtin_ctzll(word);
+				if (line >= first && line < last)
+					f(line);
+			}
+		}
+	}
+}
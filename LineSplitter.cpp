@@ -0,0 +1,343 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <cstring>
+#include <cstdint>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LPLOG_X86
+#include <immintrin.h>
+#endif
+
+#include "LineSplitter.h"
+
+// The vectorized versions only decide if a block of bytes may contain invalid UTF-8. Lines
+// overlapping such a block are validated again with the scalar version, to find the exact result.
+// Invalid UTF-8 is rare, so this costs nothing in practice.
+namespace {
+
+struct Range {
+	size_t begin, end;
+};
+
+void AddRange(std::vector<Range> &ranges, size_t begin, size_t end) {
+	if (!ranges.empty() && ranges.back().end >= begin)
+		ranges.back().end = end;
+	else
+		ranges.push_back(Range{begin, end});
+}
+
+// Scanning state shared by all implementations
+struct Scan {
+	const char *buff;
+	size_t size;
+	std::vector<LineSpan> &lines;
+	bool moreFollows;
+	size_t lineStart;
+	size_t stop;
+
+	// A newline was found at 'pos'. Return false if the scan shall stop.
+	bool Newline(size_t pos) {
+		if (moreFollows && pos == size-1)
+			return false; // Can't tell if it is a Mac newline yet.
+		size_t lineEnd = pos, next = pos + 1;
+		if (lineEnd > lineStart && buff[lineEnd-1] == '\r')
+			lineEnd--; // Windows format
+		else if (next < stop && buff[next] == '\r')
+			next++; // Mac format
+		lines.push_back(LineSpan{lineStart, unsigned(lineEnd - lineStart), true});
+		lineStart = next;
+		return true;
+	}
+
+	// Scalar scan of [from, size)
+	void Tail(size_t from, std::vector<Range> &ranges) {
+		for (size_t i = from; i < size; i++) {
+			unsigned char c = buff[i];
+			if (c == 0) {
+				stop = i;
+				return;
+			}
+			if (c & 0x80)
+				AddRange(ranges, i >= 3 ? i-3 : 0, i+1);
+			if (c == '\n' && !Newline(i))
+				return;
+		}
+	}
+};
+
+enum class Isa {
+	Scalar,
+	SSE2,
+	AVX2,
+};
+
+Isa Detect() {
+#ifdef LPLOG_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return Isa::AVX2;
+#ifdef __SSE2__
+	return Isa::SSE2;
+#endif
+#endif
+	return Isa::Scalar;
+}
+
+const Isa sIsa = Detect();
+
+void SplitScalar(Scan &scan, std::vector<Range> &ranges) {
+	const char *zero = (const char *)memchr(scan.buff, 0, scan.size);
+	if (zero != nullptr)
+		scan.stop = zero - scan.buff;
+	ranges.push_back(Range{0, scan.stop}); // Validate every line
+	for (size_t i = 0; i < scan.stop; ) {
+		const char *nl = (const char *)memchr(scan.buff + i, '\n', scan.stop - i);
+		if (nl == nullptr || !scan.Newline(nl - scan.buff))
+			return;
+		i = nl - scan.buff + 1;
+	}
+}
+
+#if defined(LPLOG_X86) && defined(__SSE2__)
+void SplitSSE2(Scan &scan, std::vector<Range> &ranges) {
+	const __m128i nlVec = _mm_set1_epi8('\n');
+	const __m128i zeroVec = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 16 <= scan.size; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(scan.buff + i));
+		unsigned zero = _mm_movemask_epi8(_mm_cmpeq_epi8(v, zeroVec));
+		unsigned nl = _mm_movemask_epi8(_mm_cmpeq_epi8(v, nlVec));
+		unsigned high = _mm_movemask_epi8(v);
+		if (zero) {
+			unsigned z = __builtin_ctz(zero);
+			scan.stop = i + z;
+			nl &= (1u << z) - 1;
+			high &= (1u << z) - 1;
+		}
+		if (high)
+			AddRange(ranges, i >= 3 ? i-3 : 0, i+16); // Non-ASCII characters, maybe invalid
+		for (; nl != 0; nl &= nl - 1) {
+			if (!scan.Newline(i + __builtin_ctz(nl)))
+				return;
+		}
+		if (zero)
+			return;
+	}
+	scan.Tail(i, ranges);
+}
+#endif
+
+#ifdef LPLOG_X86
+// UTF-8 validation using the lookup algorithm of Keiser and Lemire, "Validating UTF-8 In Less Than
+// One Instruction Per Byte". Three table lookups classify every pair of consecutive bytes.
+const uint8_t TOO_SHORT = 1<<0;
+const uint8_t TOO_LONG = 1<<1;
+const uint8_t OVERLONG_3 = 1<<2;
+const uint8_t TOO_LARGE = 1<<3;
+const uint8_t SURROGATE = 1<<4;
+const uint8_t OVERLONG_2 = 1<<5;
+const uint8_t TOO_LARGE_1000 = 1<<6;
+const uint8_t OVERLONG_4 = 1<<6;
+const uint8_t TWO_CONTS = 1<<7;
+const uint8_t CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+__attribute__((target("avx2")))
+inline __m256i Table(uint8_t a0, uint8_t a1, uint8_t a2, uint8_t a3, uint8_t a4, uint8_t a5, uint8_t a6, uint8_t a7,
+                     uint8_t a8, uint8_t a9, uint8_t a10, uint8_t a11, uint8_t a12, uint8_t a13, uint8_t a14, uint8_t a15) {
+	return _mm256_setr_epi8(a0, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14, a15,
+	                        a0, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14, a15);
+}
+
+// The bytes of 'input' shifted N steps, with the last bytes of 'prev' shifted in.
+template<int N> __attribute__((target("avx2")))
+inline __m256i Prev(__m256i input, __m256i prev) {
+	return _mm256_alignr_epi8(input, _mm256_permute2x128_si256(prev, input, 0x21), 16 - N);
+}
+
+__attribute__((target("avx2")))
+void SplitAVX2(Scan &scan, std::vector<Range> &ranges) {
+	const __m256i nlVec = _mm256_set1_epi8('\n');
+	const __m256i zeroVec = _mm256_setzero_si256();
+	const __m256i low4 = _mm256_set1_epi8(0x0f);
+	const __m256i byte1High = Table(
+		TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+		TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+		TOO_SHORT | OVERLONG_2,
+		TOO_SHORT,
+		TOO_SHORT | OVERLONG_3 | SURROGATE,
+		TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4);
+	const __m256i byte1Low = Table(
+		CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+		CARRY | OVERLONG_2,
+		CARRY,
+		CARRY,
+		CARRY | TOO_LARGE,
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+		CARRY | TOO_LARGE | TOO_LARGE_1000,
+		CARRY | TOO_LARGE | TOO_LARGE_1000);
+	const __m256i byte2High = Table(
+		TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+		TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+		TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+		TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+		TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+		TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT);
+	// A lead byte in one of the last positions means the character continues in the next block
+	const __m256i maxComplete = _mm256_setr_epi8(
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, char(0xf0-1), char(0xe0-1), char(0xc0-1));
+
+	__m256i prevInput = zeroVec, prevIncomplete = zeroVec;
+	for (size_t i = 0; i < scan.size; i += 32) {
+		__m256i v;
+		unsigned inside = 0xffffffff;
+		if (i + 32 <= scan.size) {
+			v = _mm256_loadu_si256((const __m256i *)(scan.buff + i));
+		} else {
+			// Pad the last block with zeros. This also detects incomplete characters at the end.
+			alignas(32) char tmp[32] = { 0 };
+			memcpy(tmp, scan.buff + i, scan.size - i);
+			v = _mm256_load_si256((const __m256i *)tmp);
+			inside = (1u << (scan.size - i)) - 1;
+		}
+		unsigned zero = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zeroVec)) & inside;
+		unsigned nl = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nlVec));
+		__m256i error;
+		if (_mm256_movemask_epi8(v) == 0) {
+			error = prevIncomplete;
+			prevIncomplete = zeroVec;
+		} else {
+			__m256i prev1 = Prev<1>(v, prevInput);
+			__m256i sc = _mm256_and_si256(_mm256_and_si256(
+				_mm256_shuffle_epi8(byte1High, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), low4)),
+				_mm256_shuffle_epi8(byte1Low, _mm256_and_si256(prev1, low4))),
+				_mm256_shuffle_epi8(byte2High, _mm256_and_si256(_mm256_srli_epi16(v, 4), low4)));
+			__m256i third = _mm256_subs_epu8(Prev<2>(v, prevInput), _mm256_set1_epi8(char(0xe0-0x80)));
+			__m256i fourth = _mm256_subs_epu8(Prev<3>(v, prevInput), _mm256_set1_epi8(char(0xf0-0x80)));
+			__m256i must23 = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(char(0x80)));
+			error = _mm256_xor_si256(must23, sc);
+			prevIncomplete = _mm256_subs_epu8(v, maxComplete);
+		}
+		prevInput = v;
+		if (zero) {
+			unsigned z = __builtin_ctz(zero);
+			scan.stop = i + z;
+			nl &= (1u << z) - 1;
+		}
+		if (!_mm256_testz_si256(error, error))
+			AddRange(ranges, i >= 3 ? i-3 : 0, i+32);
+		for (; nl != 0; nl &= nl - 1) {
+			if (!scan.Newline(i + __builtin_ctz(nl)))
+				return;
+		}
+		if (zero)
+			return;
+	}
+	if (!_mm256_testz_si256(prevIncomplete, prevIncomplete))
+		AddRange(ranges, scan.size >= 3 ? scan.size-3 : 0, scan.size);
+}
+#endif
+
+} // namespace
+
+bool LineSplitter::ValidUtf8(const char *str, size_t size) {
+	const unsigned char *p = (const unsigned char *)str, *end = p + size;
+	while (p < end) {
+		unsigned char c = *p;
+		if (c < 0x80) {
+			p++;
+			continue;
+		}
+		unsigned n;
+		unsigned char min = 0x80, max = 0xbf; // Allowed range of the second byte
+		if (c >= 0xc2 && c <= 0xdf)
+			n = 1;
+		else if (c >= 0xe0 && c <= 0xef) {
+			n = 2;
+			if (c == 0xe0)
+				min = 0xa0; // Overlong
+			else if (c == 0xed)
+				max = 0x9f; // Surrogate
+		} else if (c >= 0xf0 && c <= 0xf4) {
+			n = 3;
+			if (c == 0xf0)
+				min = 0x90; // Overlong
+			else if (c == 0xf4)
+				max = 0x8f; // Above U+10FFFF
+		} else
+			return false;
+		if (unsigned(end - p) <= n || p[1] < min || p[1] > max)
+			return false;
+		for (unsigned i = 2; i <= n; i++) {
+			if ((p[i] & 0xc0) != 0x80)
+				return false;
+		}
+		p += n + 1;
+	}
+	return true;
+}
+
+const char *LineSplitter::Implementation() {
+	switch (sIsa) {
+	case Isa::AVX2:
+		return "AVX2";
+	case Isa::SSE2:
+		return "SSE2";
+	case Isa::Scalar:
+		break;
+	}
+	return "scalar";
+}
+
+size_t LineSplitter::Split(const char *buff, size_t size, std::vector<LineSpan> &lines, size_t *end, bool moreFollows) {
+	Scan scan = { buff, size, lines, moreFollows, 0, size };
+	size_t firstLine = lines.size();
+	std::vector<Range> ranges;
+	switch (sIsa) {
+#ifdef LPLOG_X86
+	case Isa::AVX2:
+		SplitAVX2(scan, ranges);
+		break;
+#ifdef __SSE2__
+	case Isa::SSE2:
+		SplitSSE2(scan, ranges);
+		break;
+#endif
+#endif
+	default:
+		SplitScalar(scan, ranges);
+		break;
+	}
+	// Validate the lines that overlap a suspicious range
+	size_t r = 0;
+	for (size_t i = firstLine; i < lines.size() && r < ranges.size(); i++) {
+		LineSpan &line = lines[i];
+		while (r < ranges.size() && ranges[r].end <= line.start)
+			r++;
+		if (r < ranges.size() && ranges[r].begin < line.start + line.size)
+			line.valid = ValidUtf8(buff + line.start, line.size);
+	}
+	*end = scan.stop;
+	return scan.lineStart;
+}
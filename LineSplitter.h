@@ -0,0 +1,45 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+// One line found by the splitter. Offsets are relative to the start of the scanned buffer.
+struct LineSpan {
+	size_t start;
+	unsigned size;  // Not including the newline
+	bool valid;     // True if the line is valid UTF-8
+};
+
+// Find line endings and validate UTF-8 in one pass over a buffer.
+// A vectorized version (AVX2 or SSE2) is selected at runtime, with a scalar fallback.
+class LineSplitter
+{
+public:
+	// Split 'size' bytes into lines, accepting "\r\n" (Windows), "\n\r" (Mac) and "\n" (Unix).
+	// Complete lines are appended to 'lines'. The scan stops at the first zero byte, '*end' is set to
+	// where the scan stopped. If 'moreFollows', a newline at the very last byte is not used, as it
+	// may be the first half of a Mac newline.
+	// Return the offset of the first character after the last complete line.
+	static size_t Split(const char *buff, size_t size, std::vector<LineSpan> &lines, size_t *end, bool moreFollows);
+
+	// Scalar UTF-8 validation, with the same rules as the vectorized version.
+	static bool ValidUtf8(const char *, size_t size);
+
+	// Return the name of the implementation in use
+	static const char *Implementation();
+};
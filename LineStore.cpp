@@ -0,0 +1,361 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#endif
+
+#include "LineStore.h"
+#include "Debug.h"
+
+const unsigned LineStore::cBlockSize;
+const unsigned LineStore::cMappingShift;
+const uint64_t LineStore::cOffsetMask;
+
+namespace {
+
+// The mappings where SIGBUS is caught. The signal handler only reads the atomic ranges, and a range is removed
+// before it is unmapped.
+struct Guard {
+	std::atomic<uintptr_t> start{0};
+	std::atomic<uintptr_t> end{0};
+};
+const unsigned cMaxGuards = 1024;
+Guard sGuards[cMaxGuards];
+std::mutex sGuardsMutex; // Taken when guards are added or removed
+std::atomic<unsigned> sFaults{0};
+
+#ifndef _WIN32
+struct sigaction sPreviousAction;
+long sPageSize = 0;
+
+void BusError(int, siginfo_t *info, void *) {
+	uintptr_t address = uintptr_t(info->si_addr);
+	for (auto &guard : sGuards) {
+		if (address < guard.start.load() || address >= guard.end.load())
+			continue;
+		// The read is done again when the handler returns, and gets zeros
+		void *page = (void *)(address / sPageSize * sPageSize);
+		if (mmap(page, sPageSize, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED) {
+			sFaults++;
+			return;
+		}
+	}
+	// Not a mapped file, the read fails again the way it would have without this handler
+	sigaction(SIGBUS, &sPreviousAction, nullptr);
+}
+
+void InstallHandler() {
+	sPageSize = sysconf(_SC_PAGESIZE);
+	struct sigaction action;
+	std::memset(&action, 0, sizeof action);
+	action.sa_sigaction = BusError;
+	action.sa_flags = SA_SIGINFO;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGBUS, &action, &sPreviousAction);
+}
+#endif
+
+}
+
+unsigned LineStore::Faults() {
+	return sFaults;
+}
+
+void LineStore::AddGuard(const void *data, uint64_t size) {
+#ifndef _WIN32
+	static std::once_flag installed;
+	std::call_once(installed, InstallHandler);
+	std::lock_guard<std::mutex> lock(sGuardsMutex);
+	for (auto &guard : sGuards) {
+		if (guard.end != 0)
+			continue;
+		guard.start = uintptr_t(data);
+		guard.end = uintptr_t(data) + size;
+		return;
+	}
+	LPLOG("more than %u mappings, a truncated file is fatal", cMaxGuards);
+#endif
+}
+
+void LineStore::RemoveGuard(const void *data) {
+	std::lock_guard<std::mutex> lock(sGuardsMutex);
+	for (auto &guard : sGuards) {
+		if (guard.start == uintptr_t(data) && guard.end != 0) {
+			guard.end = 0;
+			guard.start = 0;
+			return;
+		}
+	}
+}
+
+LineStore::~LineStore() {
+	for (auto &mapping : mMappings)
+		Unmap(mapping);
+}
+
+void LineStore::Clear() {
+	for (auto &mapping : mMappings)
+		Unmap(mapping);
+	mMappings.clear();
+	mFirstMapping = 0;
+	mStores.clear();
+	mCut = false;
+	mIndex.clear();
+	mFirst = 0;
+	mBytes = 0;
+	mBlocks.clear();
+	mFirstBlock = 0;
+	mLastBlockUsed = cBlockSize;
+	mArenaSize = 0;
+}
+
+void LineStore::Unmap(Mapping &mapping) {
+#ifndef _WIN32
+	if (mapping.data != nullptr) {
+		RemoveGuard(mapping.data);
+		munmap(mapping.data, mapping.size);
+	}
+	if (mapping.fd != -1)
+		close(mapping.fd);
+#endif
+	mapping.data = nullptr;
+	mapping.size = 0;
+	mapping.fd = -1;
+}
+
+bool LineStore::Map(int fd, uint64_t size) {
+#ifdef _WIN32
+	return false;
+#else
+	if (size == 0)
+		return false;
+	if (mMappings.empty())
+		mMappings.push_back(Mapping{nullptr, 0, -1, 0});
+	Mapping &mapping = mMappings.back();
+	if (mapping.fd == -1) {
+		// The file is kept open, which keeps the content available even if the file is renamed.
+		mapping.fd = dup(fd);
+		if (mapping.fd == -1) {
+			LPLOG("failed to dup (err %d)", errno);
+			return false;
+		}
+	}
+	if (mapping.data != nullptr && size == mapping.size)
+		return true;
+	if (mapping.data != nullptr) {
+		RemoveGuard(mapping.data);
+		munmap(mapping.data, mapping.size);
+	}
+	// The index use file offsets, not pointers, so it doesn't matter if the new mapping is at another address.
+	void *p = mmap(nullptr, size, PROT_READ, MAP_SHARED, mapping.fd, 0);
+	if (p == MAP_FAILED) {
+		LPLOG("failed to map %llu bytes (err %d)", (unsigned long long)size, errno);
+		mapping.data = nullptr;
+		mapping.size = 0;
+		return false;
+	}
+	madvise(p, size, MADV_SEQUENTIAL);
+	AddGuard(p, size);
+	mapping.data = (char *)p;
+	mapping.size = size;
+	return true;
+#endif
+}
+
+void LineStore::Validate() {
+#ifndef _WIN32
+	for (unsigned i = 0; i < mMappings.size(); i++) {
+		Mapping &mapping = mMappings[i];
+		struct stat st = { 0 };
+		if (mapping.data == nullptr || fstat(mapping.fd, &st) != 0 || uint64_t(st.st_size) >= mapping.size)
+			continue;
+		LPLOG("file truncated from %llu to %llu", (unsigned long long)mapping.size, (unsigned long long)st.st_size);
+		this->CopyMapped(mFirstMapping + i, st.st_size);
+	}
+#endif
+}
+
+void LineStore::Detach(bool truncated) {
+#ifndef _WIN32
+	if (mMappings.empty())
+		return;
+	Mapping &mapping = mMappings.back();
+	if (truncated && mapping.data != nullptr) {
+		LPLOG("cut the lines of %llu bytes mapped", (unsigned long long)mapping.size);
+		this->CopyMapped(mFirstMapping + mMappings.size() - 1, 0);
+	}
+	if (mapping.lines == 0) {
+		Unmap(mapping); // Used again for the next file, the descriptor is kept even if mapping failed
+		return;
+	}
+	LPLOG("%u lines keep the mapping of %llu bytes", mapping.lines, (unsigned long long)mapping.size);
+	mMappings.push_back(Mapping{nullptr, 0, -1, 0});
+#endif
+}
+
+bool LineStore::TakeCut() {
+	bool cut = mCut;
+	mCut = false;
+	return cut;
+}
+
+void LineStore::CopyMapped(unsigned number, uint64_t available) {
+#ifndef _WIN32
+	Mapping &mapping = mMappings[number - mFirstMapping];
+	for (auto &entry : mIndex) {
+		if (!IsMapped(entry) || (entry.pos >> cMappingShift) != number)
+			continue;
+		uint64_t offset = entry.pos & cOffsetMask;
+		unsigned size = 0;
+		if (offset < available)
+			size = std::min(uint64_t(entry.size), available - offset);
+		mCut = mCut || size < entry.size;
+		mBytes -= entry.size - size;
+		entry = Allocate(mapping.data + offset, size);
+	}
+	mapping.lines = 0;
+	Unmap(mapping);
+#endif
+}
+
+LineStore::Entry LineStore::Allocate(const char *data, unsigned size) {
+	Entry entry = { cOwnedFlag, size };
+	if (size == 0)
+		return entry;
+	if (size > cBlockSize - mLastBlockUsed) {
+		// A line longer than a block gets a block of its own.
+		unsigned blockSize = std::max(size, cBlockSize);
+		mBlocks.push_back(Block{std::unique_ptr<char[]>(new char[blockSize]), blockSize, 0});
+		mArenaSize += blockSize;
+		mLastBlockUsed = 0;
+	}
+	mBlocks.back().lines++;
+	entry.pos |= (uint64_t(mFirstBlock + mBlocks.size() - 1) << 32) | mLastBlockUsed;
+	std::memcpy(mBlocks.back().data.get() + mLastBlockUsed, data, size);
+	mLastBlockUsed = std::min(mLastBlockUsed + size, cBlockSize);
+	return entry;
+}
+
+void LineStore::AddMapped(uint64_t offset, unsigned size) {
+	mMappings.back().lines++;
+	mIndex.push_back(Entry{(uint64_t(mFirstMapping + mMappings.size() - 1) << cMappingShift) | offset, size});
+	mBytes += size;
+}
+
+void LineStore::AddOwned(const char *data, unsigned size) {
+	mIndex.push_back(Allocate(data, size));
+	mBytes += size;
+}
+
+void LineStore::AddReference(LineStore *store, unsigned line) {
+	unsigned index = std::find(mStores.begin(), mStores.end(), store) - mStores.begin();
+	if (index == mStores.size())
+		mStores.push_back(store);
+	unsigned size = store->mIndex[line - store->mFirst].size;
+	mIndex.push_back(Entry{cReferenceFlag | (uint64_t(index) << 32) | line, size});
+	mBytes += size;
+}
+
+void LineStore::Replace(unsigned line, const std::string &str) {
+	// The old copy, if owned, is left unused in the arena until the block is freed. Replacements are rare.
+	Entry &entry = mIndex[line - mFirst];
+	if (IsMapped(entry))
+		mMappings[(entry.pos >> cMappingShift) - mFirstMapping].lines--;
+	else if ((entry.pos & cOwnedFlag) && entry.size > 0)
+		mBlocks[((entry.pos & ~cOwnedFlag) >> 32) - mFirstBlock].lines--;
+	mBytes += str.size() - entry.size;
+	entry = Allocate(str.data(), str.size());
+}
+
+void LineStore::MoveToFront(unsigned first) {
+	// One at a time from the back, to take time for the lines moved only
+	for (size_t n = mIndex.size() - (first - mFirst); n > 0; n--) {
+		Entry entry = mIndex.back();
+		mIndex.pop_back();
+		mIndex.push_front(entry);
+	}
+}
+
+void LineStore::Evict(unsigned first) {
+	// The pages of a file are no longer needed up to the end of the last line evicted, as lines are in the order
+	// of the file, except those that are owned
+	unsigned mapping = 0;
+	uint64_t mappedEnd = 0;
+	auto release = [this, &mapping, &mappedEnd]() {
+#ifndef _WIN32
+		Mapping &m = mMappings[mapping - mFirstMapping];
+		long page = sysconf(_SC_PAGESIZE);
+		mappedEnd = std::min(mappedEnd, m.size) / page * page;
+		if (m.data != nullptr && mappedEnd > 0)
+			madvise(m.data, mappedEnd, MADV_DONTNEED);
+#endif
+		mappedEnd = 0;
+	};
+	for (; mFirst < first && !mIndex.empty(); mFirst++) {
+		const Entry &entry = mIndex.front();
+		if (IsMapped(entry)) {
+			if ((entry.pos >> cMappingShift) != mapping && mappedEnd > 0)
+				release();
+			mapping = entry.pos >> cMappingShift;
+			mappedEnd = (entry.pos & cOffsetMask) + entry.size;
+			mMappings[mapping - mFirstMapping].lines--;
+		} else if ((entry.pos & cOwnedFlag) && entry.size > 0) {
+			mBlocks[((entry.pos & ~cOwnedFlag) >> 32) - mFirstBlock].lines--;
+		}
+		mBytes -= entry.size;
+		mIndex.pop_front();
+	}
+	if (mappedEnd > 0)
+		release();
+	// The last block is kept, as it is where new lines are added
+	while (mBlocks.size() > 1 && mBlocks.front().lines == 0) {
+		mArenaSize -= mBlocks.front().size;
+		mBlocks.pop_front();
+		mFirstBlock++;
+	}
+	// The same for the mappings, where a file that was rotated is closed when its last line is evicted
+	while (mMappings.size() > 1 && mMappings.front().lines == 0) {
+		Unmap(mMappings.front());
+		mMappings.pop_front();
+		mFirstMapping++;
+	}
+}
+
+LineRef LineStore::Get(unsigned line) const {
+	const Entry &entry = mIndex[line - mFirst];
+	if (IsMapped(entry))
+		return LineRef{mMappings[(entry.pos >> cMappingShift) - mFirstMapping].data + (entry.pos & cOffsetMask), entry.size};
+	if (!(entry.pos & cOwnedFlag))
+		return mStores[(entry.pos & ~cReferenceFlag) >> 32]->Get(uint32_t(entry.pos));
+	if (entry.size == 0)
+		return LineRef{"", 0};
+	unsigned block = (entry.pos & ~cOwnedFlag) >> 32;
+	unsigned offset = entry.pos & 0xffffffff;
+	return LineRef{mBlocks[block - mFirstBlock].data.get() + offset, entry.size};
+}
+
+uint64_t LineStore::MemoryUsage() const {
+	return mIndex.size() * sizeof(Entry) + mArenaSize;
+}
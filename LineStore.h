@@ -0,0 +1,132 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+
+// A reference to the characters of one line, not including the newline.
+// It is only valid until the next change of the LineStore it came from.
+struct LineRef {
+	const char *data;
+	unsigned size;
+	std::string str() const { return std::string(data, size); }
+	bool operator==(const LineRef &other) const { return size == other.size && std::memcmp(data, other.data, size) == 0; }
+	bool operator!=(const LineRef &other) const { return !(*this == other); }
+};
+
+// Storage of all lines in a document.
+// Lines are either references into a memory mapped file, or copies in an arena owned by the store. Lines of files
+// that were rotated, and are no longer added to, refer to mappings of their own until the lines are evicted.
+// The lines of a merged document are lines of the stores of the files, see AddReference().
+// Only a compact array of offsets is kept for every line, there is no allocation per line.
+// The oldest lines can be evicted, and line numbers are still counted from the first line added.
+class LineStore
+{
+public:
+	LineStore() = default;
+	~LineStore();
+	void Clear();
+
+	// Map 'size' bytes of an open file, remapping if it was already mapped. Return false if mapping isn't possible.
+	// The store keeps a duplicate of the descriptor.
+	bool Map(int fd, uint64_t size);
+	bool IsMapped() const { return !mMappings.empty() && mMappings.back().data != nullptr; }
+	// Test that no mapped file was truncated. If one was, copy what remains and drop the mapping.
+	// A file can be truncated at any time, also while lines are read by other threads. Reading a mapping beyond the
+	// end of the file raises SIGBUS, which is caught: the page is replaced by zeros, and Faults() is counted up.
+	// Call this when a file is known to be smaller, or Faults() changed, to cut the lines that are gone.
+	void Validate();
+	static unsigned Faults(); // Reads beyond the end of a mapped file so far, in all stores
+	// Catch reads beyond the end of the file in a mapping, the same way as for the mappings of a store
+	static void AddGuard(const void *, uint64_t size);
+	static void RemoveGuard(const void *);
+	// The lines that follow will refer to another file, or to the same file truncated. The lines that refer to the
+	// file mapped now keep the mapping, unless 'truncated'. They are then cut the same way as by Validate().
+	void Detach(bool truncated);
+	// True if lines were cut since the last call, by Validate() or Detach(). They are shorter, or empty, now.
+	bool TakeCut();
+
+	void AddMapped(uint64_t offset, unsigned size); // Add a line that is a reference into the mapped file
+	void AddOwned(const char *, unsigned size);      // Add a line that is copied into the arena
+	// Add a line that is a line of another store. That store has to keep the line, and is validated by its owner.
+	void AddReference(LineStore *, unsigned line);
+	void Replace(unsigned line, const std::string &); // Replace the content of a line, which will then be owned
+	void MoveToFront(unsigned first); // Move the lines from 'first' to before all other lines
+	// Forget all lines before 'first'. Blocks of the arena are freed when none of their lines are left.
+	void Evict(unsigned first);
+
+	LineRef Get(unsigned line) const;
+	LineRef operator[](unsigned line) const { return Get(line); }
+	unsigned size() const { return mFirst + mIndex.size(); } // Including lines evicted
+	unsigned First() const { return mFirst; } // The first line that wasn't evicted
+	uint64_t Bytes() const { return mBytes; } // Characters in the lines that are kept
+	uint64_t MemoryUsage() const; // Approximate number of bytes allocated, not counting the mapped file
+
+private:
+	// The high bit of 'pos' is set when the line is in the arena. The arena position is then
+	// the block number in the upper part and the offset in the block in the lower 32 bits.
+	// The bit after it is set when the line is in another store, with the index in mStores in the upper part and
+	// the line number in the lower 32 bits.
+	// Otherwise, 'pos' is the mapping number in the upper part and the offset in the file in the lower 44 bits.
+	struct Entry {
+		uint64_t pos;
+		uint32_t size;
+	};
+	static const uint64_t cOwnedFlag = uint64_t(1) << 63;
+	static const uint64_t cReferenceFlag = uint64_t(1) << 62;
+	static const unsigned cMappingShift = 44;
+	static const uint64_t cOffsetMask = (uint64_t(1) << cMappingShift) - 1;
+	static bool IsMapped(const Entry &entry) { return !(entry.pos & (cOwnedFlag | cReferenceFlag)); }
+	static const unsigned cBlockSize = 4*1024*1024;
+	std::deque<Entry> mIndex;
+	unsigned mFirst = 0;    // Line number of mIndex[0]
+	uint64_t mBytes = 0;
+
+	// The arena. Block numbers are counted from the first block allocated, which is mBlocks[0] until blocks are freed.
+	struct Block {
+		std::unique_ptr<char[]> data;
+		unsigned size;
+		unsigned lines; // Lines that use the block
+	};
+	std::deque<Block> mBlocks;
+	unsigned mFirstBlock = 0;
+	unsigned mLastBlockUsed = cBlockSize;         // Bytes used in the last block
+	uint64_t mArenaSize = 0;
+	Entry Allocate(const char *, unsigned size);
+
+	// The mapped files. Mapping numbers are counted the same way as blocks, and lines are added to the last mapping.
+	struct Mapping {
+		char *data;
+		uint64_t size;
+		int fd;
+		unsigned lines; // Lines that refer to the mapping
+	};
+	std::deque<Mapping> mMappings;
+	std::vector<LineStore *> mStores; // That lines refer to
+	unsigned mFirstMapping = 0;
+	bool mCut = false;
+	static void Unmap(Mapping &);
+	// Copy the lines of a mapping to the arena, up to 'available' bytes of the file, and unmap
+	void CopyMapped(unsigned mapping, uint64_t available);
+
+	LineStore(const LineStore &) = delete;
+	LineStore &operator=(const LineStore &) = delete;
+};
@@ -0,0 +1,473 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <algorithm>
+#include <gdk/gdkkeysyms.h> // Needed for GTK+-2.0
+
+#include "LogView.h"
+#include "Document.h"
+#include "Debug.h"
+
+static const double cScrollRows = 3; // Rows scrolled by one step of the mouse wheel
+
+// Set the value of an adjustment, within the limits of the scrollable range.
+static void SetValue(GtkAdjustment *adj, double value) {
+	double max = gtk_adjustment_get_upper(adj) - gtk_adjustment_get_page_size(adj);
+	value = std::max(gtk_adjustment_get_lower(adj), std::min(value, max));
+	gtk_adjustment_set_value(adj, value);
+}
+
+LogView::LogView(Document *doc) : mDoc(doc) {
+	mVertical = GTK_ADJUSTMENT(gtk_adjustment_new(0, 0, 0, 1, 1, 1));
+	mHorizontal = GTK_ADJUSTMENT(gtk_adjustment_new(0, 0, 0, 1, 1, 1));
+	mArea = gtk_drawing_area_new();
+	gtk_widget_set_can_focus(mArea, TRUE);
+	gint events = GDK_BUTTON_PRESS_MASK | GDK_BUTTON_RELEASE_MASK | GDK_BUTTON_MOTION_MASK | GDK_SCROLL_MASK | GDK_KEY_PRESS_MASK;
+#if GTK_CHECK_VERSION(3,4,0)
+	events |= GDK_SMOOTH_SCROLL_MASK;
+#endif
+	gtk_widget_add_events(mArea, events);
+	PangoFontDescription *font = pango_font_description_from_string("Monospace Regular 8");
+#if GTK_CHECK_VERSION(3,0,0)
+	gtk_widget_override_font(mArea, font);
+#else
+	gtk_widget_modify_font(mArea, font);
+#endif
+	pango_font_description_free(font);
+
+	// The scrollbars are managed here, instead of using a scrolled window, as the text can be much
+	// higher than the size a widget is allowed to have.
+#if GTK_CHECK_VERSION(3,0,0)
+	mTop = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
+	GtkWidget *hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
+	GtkWidget *vscroll = gtk_scrollbar_new(GTK_ORIENTATION_VERTICAL, mVertical);
+	GtkWidget *hscroll = gtk_scrollbar_new(GTK_ORIENTATION_HORIZONTAL, mHorizontal);
+#else
+	mTop = gtk_vbox_new(FALSE, 0);
+	GtkWidget *hbox = gtk_hbox_new(FALSE, 0);
+	GtkWidget *vscroll = gtk_vscrollbar_new(mVertical);
+	GtkWidget *hscroll = gtk_hscrollbar_new(mHorizontal);
+#endif // GTK_CHECK_VERSION
+	gtk_container_set_border_width(GTK_CONTAINER(mTop), 1);
+	gtk_box_pack_start(GTK_BOX(hbox), mArea, TRUE, TRUE, 0);
+	gtk_box_pack_start(GTK_BOX(hbox), vscroll, FALSE, FALSE, 0);
+	gtk_box_pack_start(GTK_BOX(mTop), hbox, TRUE, TRUE, 0);
+	gtk_box_pack_start(GTK_BOX(mTop), hscroll, FALSE, FALSE, 0);
+
+#if GTK_CHECK_VERSION(3,0,0)
+	g_signal_connect(G_OBJECT(mArea), "draw", G_CALLBACK(DrawCB), this);
+#else
+	g_signal_connect(G_OBJECT(mArea), "expose-event", G_CALLBACK(ExposeCB), this);
+#endif
+	g_signal_connect(G_OBJECT(mArea), "button-press-event", G_CALLBACK(ButtonPressCB), this);
+	g_signal_connect(G_OBJECT(mArea), "button-release-event", G_CALLBACK(ButtonReleaseCB), this);
+	g_signal_connect(G_OBJECT(mArea), "motion-notify-event", G_CALLBACK(MotionCB), this);
+	g_signal_connect(G_OBJECT(mArea), "scroll-event", G_CALLBACK(ScrollCB), this);
+	// Keys are first handled by the controller, which lets through what it doesn't use
+	g_signal_connect_after(G_OBJECT(mArea), "key-press-event", G_CALLBACK(KeyPressCB), this);
+	g_signal_connect(G_OBJECT(mArea), "size-allocate", G_CALLBACK(AllocateCB), this);
+	g_signal_connect(G_OBJECT(mVertical), "value-changed", G_CALLBACK(ValueChangedCB), this);
+	g_signal_connect(G_OBJECT(mHorizontal), "value-changed", G_CALLBACK(ValueChangedCB), this);
+	g_signal_connect(G_OBJECT(mTop), "destroy", G_CALLBACK(DestroyCB), this);
+	MeasureFont();
+}
+
+void LogView::MeasureFont() {
+	PangoLayout *layout = gtk_widget_create_pango_layout(mArea, "0");
+	pango_layout_get_pixel_size(layout, &mCharWidth, &mRowHeight);
+	g_object_unref(layout);
+	mCharWidth = std::max(mCharWidth, 1);
+	mRowHeight = std::max(mRowHeight, 1);
+}
+
+void LogView::UpdateAdjustments() {
+	GtkAllocation alloc;
+	gtk_widget_get_allocation(mArea, &alloc);
+	double rows = double(alloc.height) / mRowHeight;
+	double value = std::min(gtk_adjustment_get_value(mVertical), std::max(0.0, GetNumRows() - rows));
+	gtk_adjustment_configure(mVertical, value, 0, GetNumRows(), 1, std::max(1.0, rows - 1), rows);
+	unsigned numberSize = mShowLineNumbers ? 8 : 0; // The line number and the tab
+	if (mDoc->Merged())
+		numberSize += mDoc->SourceNameSize() + 1;
+	double width = double(mMaxRowSize + numberSize) * mCharWidth + cMargin;
+	value = std::min(gtk_adjustment_get_value(mHorizontal), std::max(0.0, width - alloc.width));
+	gtk_adjustment_configure(mHorizontal, value, 0, width, mCharWidth, alloc.width / 2, alloc.width);
+}
+
+void LogView::Update(bool replaced) {
+	unsigned numRows = GetNumRows();
+	if (replaced) {
+		mMaxRowSize = 0;
+		mAnchor = mCursor = Position{ 0, 0 };
+	}
+	// The width is only estimated from the rows at the end, as all rows may be many.
+	// It grows when wider rows are drawn.
+	for (unsigned row = numRows > 1000 ? numRows - 1000 : 0; row < numRows; row++)
+		mMaxRowSize = std::max(mMaxRowSize, RowSize(row));
+	UpdateAdjustments();
+	gtk_widget_queue_draw(mArea);
+}
+
+void LogView::SetShowLineNumbers(bool show) {
+	if (show == mShowLineNumbers)
+		return;
+	mShowLineNumbers = show;
+	mAnchor = mCursor = Position{ 0, 0 }; // Offsets in the rows are no longer the same
+	UpdateAdjustments();
+	gtk_widget_queue_draw(mArea);
+}
+
+void LogView::ScrollToEnd() {
+	SetValue(mVertical, gtk_adjustment_get_upper(mVertical));
+}
+
+void LogView::ScrollToRow(unsigned row) {
+	SetValue(mVertical, row);
+}
+
+unsigned LogView::GetTopRow() const {
+	return unsigned(gtk_adjustment_get_value(mVertical));
+}
+
+void LogView::RemoveRows(unsigned rows) {
+	auto Shift = [rows](Position &p) { p = p.row >= rows ? Position{ p.row - rows, p.offset } : Position{ 0, 0 }; };
+	Shift(mAnchor);
+	Shift(mCursor);
+	SetValue(mVertical, std::max(0.0, gtk_adjustment_get_value(mVertical) - rows));
+}
+
+unsigned LogView::GetNumRows() const {
+	return mDoc->GetNumShownLines();
+}
+
+std::string LogView::GetRowText(unsigned row) const {
+	unsigned lineNumber;
+	LineRef line = mDoc->GetShownLine(row, &lineNumber);
+	std::string text = GetPrefix(lineNumber);
+	text.append(line.data, line.size);
+	return text;
+}
+
+unsigned LogView::GetPrefixSize(unsigned row) const {
+	if (!mShowLineNumbers && !mDoc->Merged())
+		return 0;
+	unsigned lineNumber;
+	mDoc->GetShownLine(row, &lineNumber);
+	return GetPrefix(lineNumber).size();
+}
+
+std::string LogView::GetPrefix(unsigned lineNumber) const {
+	std::string text;
+	if (mShowLineNumbers) {
+		text = std::to_string(lineNumber+1);
+		text += '\t';
+	}
+	if (mDoc->Merged()) {
+		// The names are padded to the same size, to keep the lines aligned
+		const std::string &name = mDoc->GetSourceName(lineNumber);
+		text += name;
+		text.append(mDoc->SourceNameSize() - name.size() + 1, ' ');
+	}
+	return text;
+}
+
+unsigned LogView::RowSize(unsigned row) const {
+	unsigned lineNumber;
+	return mDoc->GetShownLine(row, &lineNumber).size;
+}
+
+std::string LogView::VisibleText(unsigned row) const {
+	std::string text = GetRowText(row);
+	GtkAllocation alloc;
+	gtk_widget_get_allocation(mArea, &alloc);
+	// A character is never narrower than a column, so this many characters fill the window
+	unsigned maxChars = (gtk_adjustment_get_value(mHorizontal) + alloc.width) / mCharWidth + 1;
+	const char *p = text.c_str(), *end = p + text.size();
+	for (unsigned n = 0; p < end && n < maxChars; n++)
+		p = g_utf8_next_char(p);
+	text.resize(std::min(end, p) - text.c_str());
+	return text;
+}
+
+void LogView::Select(unsigned row, unsigned start, unsigned end) {
+	mAnchor = Position{ row, start };
+	mCursor = Position{ row, end };
+	double value = gtk_adjustment_get_value(mHorizontal);
+	double x = double(end) * mCharWidth + cMargin;
+	double page = gtk_adjustment_get_page_size(mHorizontal);
+	if (x > value + page || start * mCharWidth < value)
+		SetValue(mHorizontal, x - page / 2); // Make sure the selection is visible
+	gtk_widget_queue_draw(mArea);
+}
+
+void LogView::SetHighlight(const Finder &finder) {
+	if (finder.str() == mHighlight.str() && finder.CaseSensitive() == mHighlight.CaseSensitive())
+		return;
+	mHighlight = finder;
+	gtk_widget_queue_draw(mArea);
+}
+
+void LogView::AddHighlights(unsigned row, unsigned visibleSize, PangoAttrList *attributes) {
+	if (mHighlight.str().empty())
+		return;
+	unsigned lineNumber;
+	LineRef line = mDoc->GetShownLine(row, &lineNumber);
+	unsigned prefix = GetPrefixSize(row);
+	if (visibleSize <= prefix)
+		return;
+	// Only matches that start in the visible part are of interest. A regular expression may need more of the line.
+	size_t end = std::min<size_t>(line.size, visibleSize - prefix + mHighlight.str().size() - 1);
+	for (size_t pos = 0, size = 0; pos < end; pos += std::max<size_t>(size, 1)) {
+		pos = mHighlight.Find(line.data, line.size, &size, pos); // The whole line, for e.g. '^' and '\b'
+		if (pos == Finder::npos || pos >= end)
+			break;
+		PangoAttribute *attribute = pango_attr_background_new(0xffff, 0xeeee, 0x5555);
+		attribute->start_index = prefix + pos;
+		attribute->end_index = prefix + pos + size;
+		pango_attr_list_insert(attributes, attribute);
+	}
+}
+
+std::string LogView::GetSelectedText() const {
+	Position start = std::min(mAnchor, mCursor), end = std::max(mAnchor, mCursor);
+	std::string ret;
+	for (unsigned row = start.row; row <= end.row && row < GetNumRows(); row++) {
+		std::string text = GetRowText(row);
+		size_t from = row == start.row ? std::min<size_t>(start.offset, text.size()) : 0;
+		size_t to = row == end.row ? std::min<size_t>(end.offset, text.size()) : text.size();
+		if (row != start.row)
+			ret += '\n';
+		ret.append(text, from, to - from);
+	}
+	return ret;
+}
+
+void LogView::Copy(GdkAtom selection) {
+	if (!HasSelection())
+		return;
+	std::string text = GetSelectedText();
+	gtk_clipboard_set_text(gtk_clipboard_get(selection), text.data(), text.size());
+}
+
+LogView::Position LogView::PositionAt(double x, double y) const {
+	unsigned numRows = GetNumRows();
+	if (numRows == 0)
+		return Position{ 0, 0 };
+	double row = std::max(0.0, gtk_adjustment_get_value(mVertical) + y / mRowHeight);
+	Position pos = { std::min(unsigned(row), numRows - 1), 0 };
+	std::string text = VisibleText(pos.row);
+	PangoLayout *layout = gtk_widget_create_pango_layout(mArea, text.c_str());
+	int index = 0, trailing = 0;
+	x += gtk_adjustment_get_value(mHorizontal) - cMargin;
+	pango_layout_xy_to_index(layout, int(x * PANGO_SCALE), 0, &index, &trailing);
+	g_object_unref(layout);
+	const char *p = text.c_str() + index;
+	for (; trailing > 0 && *p != 0; trailing--)
+		p = g_utf8_next_char(p);
+	pos.offset = p - text.c_str();
+	return pos;
+}
+
+void LogView::Draw(cairo_t *cr) {
+	Metrics::Scope scope(mDoc->GetMetrics(), Metrics::Timer::Draw);
+	GtkAllocation alloc;
+	gtk_widget_get_allocation(mArea, &alloc);
+	cairo_set_source_rgb(cr, 1, 1, 1);
+	cairo_paint(cr);
+	cairo_set_source_rgb(cr, 0, 0, 0);
+	mDoc->ValidateLines();
+	unsigned numRows = GetNumRows();
+	double top = gtk_adjustment_get_value(mVertical);
+	double x = cMargin - gtk_adjustment_get_value(mHorizontal);
+	Position start = std::min(mAnchor, mCursor), end = std::max(mAnchor, mCursor);
+	unsigned maxRowSize = mMaxRowSize;
+	// One layout is used for all rows, and only the rows that are visible are laid out
+	PangoLayout *layout = gtk_widget_create_pango_layout(mArea, nullptr);
+	unsigned row = unsigned(top);
+	for (double y = (row - top) * mRowHeight; row < numRows && y < alloc.height; row++, y += mRowHeight) {
+		maxRowSize = std::max(maxRowSize, RowSize(row));
+		std::string text = VisibleText(row);
+		pango_layout_set_text(layout, text.data(), text.size());
+		PangoAttrList *attributes = pango_attr_list_new();
+		AddHighlights(row, text.size(), attributes); // The selection is added after, to be on top
+		if (HasSelection() && start.row <= row && row <= end.row) {
+			PangoAttribute *background = pango_attr_background_new(0x4a4a, 0x9090, 0xd9d9);
+			PangoAttribute *foreground = pango_attr_foreground_new(0xffff, 0xffff, 0xffff);
+			for (auto attribute : { background, foreground }) {
+				attribute->start_index = row == start.row ? start.offset : 0;
+				attribute->end_index = row == end.row ? end.offset : G_MAXUINT;
+				pango_attr_list_insert(attributes, attribute);
+			}
+		}
+		pango_layout_set_attributes(layout, attributes);
+		pango_attr_list_unref(attributes);
+		cairo_move_to(cr, x, y);
+		pango_cairo_show_layout(cr, layout);
+	}
+	g_object_unref(layout);
+	if (maxRowSize > mMaxRowSize) {
+		mMaxRowSize = maxRowSize;
+		UpdateAdjustments();
+	}
+}
+
+bool LogView::ButtonPress(GdkEventButton *event) {
+	if (event->button != 1)
+		return false;
+	gtk_widget_grab_focus(mArea);
+	Position pos = PositionAt(event->x, event->y);
+	if (event->type == GDK_2BUTTON_PRESS || event->type == GDK_3BUTTON_PRESS) {
+		// Select the word, or the whole row
+		std::string text = GetRowText(pos.row);
+		unsigned first = 0, last = text.size();
+		if (event->type == GDK_2BUTTON_PRESS) {
+			auto IsWord = [](char c) { return !g_ascii_isspace(c); };
+			for (first = std::min<unsigned>(pos.offset, last); first > 0 && IsWord(text[first-1]); first--)
+				;
+			for (last = first; last < text.size() && IsWord(text[last]); last++)
+				;
+		}
+		mAnchor = Position{ pos.row, first };
+		mCursor = Position{ pos.row, last };
+		mSelecting = false;
+		Copy(GDK_SELECTION_PRIMARY);
+	} else {
+		if (!(event->state & GDK_SHIFT_MASK))
+			mAnchor = pos;
+		mCursor = pos;
+		mSelecting = true;
+	}
+	gtk_widget_queue_draw(mArea);
+	return true;
+}
+
+bool LogView::ButtonRelease(GdkEventButton *event) {
+	if (event->button != 1 || !mSelecting)
+		return false;
+	mSelecting = false;
+	Copy(GDK_SELECTION_PRIMARY);
+	return true;
+}
+
+bool LogView::Motion(GdkEventMotion *event) {
+	if (!mSelecting)
+		return false;
+	// Scroll when the selection is dragged outside
+	GtkAllocation alloc;
+	gtk_widget_get_allocation(mArea, &alloc);
+	double value = gtk_adjustment_get_value(mVertical);
+	if (event->y < 0)
+		SetValue(mVertical, value - 1);
+	else if (event->y > alloc.height)
+		SetValue(mVertical, value + 1);
+	mCursor = PositionAt(event->x, std::max(0.0, std::min(event->y, double(alloc.height - 1))));
+	gtk_widget_queue_draw(mArea);
+	return true;
+}
+
+bool LogView::Scroll(GdkEventScroll *event) {
+	double rows = 0, columns = 0;
+	switch (event->direction) {
+	case GDK_SCROLL_UP:
+		rows = -cScrollRows;
+		break;
+	case GDK_SCROLL_DOWN:
+		rows = cScrollRows;
+		break;
+	case GDK_SCROLL_LEFT:
+		columns = -cScrollRows;
+		break;
+	case GDK_SCROLL_RIGHT:
+		columns = cScrollRows;
+		break;
+#if GTK_CHECK_VERSION(3,4,0)
+	case GDK_SCROLL_SMOOTH:
+		gdk_event_get_scroll_deltas((GdkEvent *)event, &columns, &rows);
+		rows *= cScrollRows;
+		columns *= cScrollRows;
+		break;
+#endif
+	default:
+		return false;
+	}
+	if (event->state & GDK_SHIFT_MASK)
+		std::swap(rows, columns);
+	SetValue(mVertical, gtk_adjustment_get_value(mVertical) + rows);
+	SetValue(mHorizontal, gtk_adjustment_get_value(mHorizontal) + columns * mCharWidth);
+	return true;
+}
+
+bool LogView::KeyPress(GdkEventKey *event) {
+	bool control = event->state & GDK_CONTROL_MASK;
+	if (control && (gdk_keyval_to_lower(event->keyval) == GDK_KEY_c || event->keyval == GDK_KEY_Insert)) {
+		Copy(GDK_SELECTION_CLIPBOARD);
+		return true;
+	}
+	return false;
+}
+
+void LogView::Allocated() {
+	MeasureFont(); // The font may have changed when the widget was realized
+	UpdateAdjustments();
+}
+
+#if GTK_CHECK_VERSION(3,0,0)
+gboolean LogView::DrawCB(GtkWidget *, cairo_t *cr, LogView *view) {
+	view->Draw(cr);
+	return true;
+}
+#else
+gboolean LogView::ExposeCB(GtkWidget *widget, GdkEventExpose *, LogView *view) {
+	cairo_t *cr = gdk_cairo_create(gtk_widget_get_window(widget));
+	view->Draw(cr);
+	cairo_destroy(cr);
+	return true;
+}
+#endif
+
+gboolean LogView::ButtonPressCB(GtkWidget *, GdkEventButton *event, LogView *view) {
+	return view->ButtonPress(event);
+}
+
+gboolean LogView::ButtonReleaseCB(GtkWidget *, GdkEventButton *event, LogView *view) {
+	return view->ButtonRelease(event);
+}
+
+gboolean LogView::MotionCB(GtkWidget *, GdkEventMotion *event, LogView *view) {
+	return view->Motion(event);
+}
+
+gboolean LogView::ScrollCB(GtkWidget *, GdkEventScroll *event, LogView *view) {
+	return view->Scroll(event);
+}
+
+gboolean LogView::KeyPressCB(GtkWidget *, GdkEventKey *event, LogView *view) {
+	return view->KeyPress(event);
+}
+
+void LogView::AllocateCB(GtkWidget *, GdkRectangle *, LogView *view) {
+	view->Allocated();
+}
+
+void LogView::ValueChangedCB(GtkAdjustment *, LogView *view) {
+	gtk_widget_queue_draw(view->mArea);
+}
+
+void LogView::DestroyCB(GtkWidget *, LogView *view) {
+	LPLOG("");
+	if (view->mDoc->mLogView == view)
+		view->mDoc->mLogView = nullptr;
+	delete view;
+}
@@ -0,0 +1,110 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <gtk/gtk.h>
+#include <string>
+
+#include "Finder.h"
+
+class Document;
+
+// Display of the lines of a document that passed the filter.
+// Nothing is copied from the document. Pango layouts are created only for the rows that are
+// visible, when they are drawn, which makes the time and memory independent of the number of rows.
+// Rows have a fixed height, and are not wrapped.
+class LogView
+{
+public:
+	explicit LogView(Document *);
+	GtkWidget *GetWidget() const { return mTop; }      // To be added to a container
+	GtkWidget *GetTextWidget() const { return mArea; } // Where key presses and drops are received
+
+	// The rows of the document have changed. If 'replaced', all rows are new, otherwise rows were added at the end.
+	void Update(bool replaced);
+	void SetShowLineNumbers(bool);
+	void ScrollToEnd();
+	void ScrollToRow(unsigned row); // Show the row at the top
+	unsigned GetTopRow() const;
+	void RemoveRows(unsigned rows); // The first rows were removed, keep showing the same rows
+	unsigned GetNumRows() const;
+	// The text of a row, as it is displayed
+	std::string GetRowText(unsigned row) const;
+	unsigned GetPrefixSize(unsigned row) const; // Bytes before the line in the row text, the line number and the file
+	// Select bytes from 'start' to 'end' of a row
+	void Select(unsigned row, unsigned start, unsigned end);
+	std::string GetSelectedText() const;
+	void SetHighlight(const Finder &); // Mark all places with the string, in the rows that are visible
+
+private:
+	struct Position {
+		unsigned row;
+		unsigned offset; // Byte in the row text
+		bool operator<(const Position &other) const { return row < other.row || (row == other.row && offset < other.offset); }
+		bool operator==(const Position &other) const { return row == other.row && offset == other.offset; }
+	};
+	Document *mDoc;
+	GtkWidget *mTop;
+	GtkWidget *mArea;
+	GtkAdjustment *mVertical;   // In rows
+	GtkAdjustment *mHorizontal; // In pixels
+	bool mShowLineNumbers = false;
+	std::string GetPrefix(unsigned lineNumber) const; // The line number, if shown, and the file of a merged line
+	int mRowHeight = 0;
+	int mCharWidth = 0;
+	unsigned mMaxRowSize = 0;   // Bytes in the longest row, to know the width
+	Position mAnchor = { 0, 0 }; // Where the selection started
+	Position mCursor = { 0, 0 }; // Where the selection ends
+	bool mSelecting = false;     // The mouse button is pressed
+	Finder mHighlight;
+
+	static const int cMargin = 2; // Pixels to the left of the text
+	void MeasureFont();
+	void UpdateAdjustments();
+	unsigned RowSize(unsigned row) const;
+	// Only as much of the row as can be visible is given to Pango, as very long lines are expensive.
+	std::string VisibleText(unsigned row) const;
+	Position PositionAt(double x, double y) const;
+	bool HasSelection() const { return !(mAnchor == mCursor); }
+	void AddHighlights(unsigned row, unsigned visibleSize, PangoAttrList *);
+	void Copy(GdkAtom selection);
+
+	void Draw(cairo_t *);
+	bool ButtonPress(GdkEventButton *);
+	bool ButtonRelease(GdkEventButton *);
+	bool Motion(GdkEventMotion *);
+	bool Scroll(GdkEventScroll *);
+	bool KeyPress(GdkEventKey *);
+	void Allocated();
+
+	// Callbacks from GTK
+#if GTK_CHECK_VERSION(3,0,0)
+	static gboolean DrawCB(GtkWidget *, cairo_t *, LogView *);
+#else
+	static gboolean ExposeCB(GtkWidget *, GdkEventExpose *, LogView *);
+#endif
+	static gboolean ButtonPressCB(GtkWidget *, GdkEventButton *, LogView *);
+	static gboolean ButtonReleaseCB(GtkWidget *, GdkEventButton *, LogView *);
+	static gboolean MotionCB(GtkWidget *, GdkEventMotion *, LogView *);
+	static gboolean ScrollCB(GtkWidget *, GdkEventScroll *, LogView *);
+	static gboolean KeyPressCB(GtkWidget *, GdkEventKey *, LogView *);
+	static void AllocateCB(GtkWidget *, GdkRectangle *, LogView *);
+	static void ValueChangedCB(GtkAdjustment *, LogView *);
+	static void DestroyCB(GtkWidget *, LogView *);
+
+	LogView(const LogView &) = delete;
+	LogView &operator=(const LogView &) = delete;
+};
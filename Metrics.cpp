@@ -0,0 +1,45 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include <cstdio>
+
+#include "Metrics.h"
+
+static const char *sNames[] = { "read", "split", "update", "filter", "append", "replace", "find", "draw" };
+
+void Metrics::Add(Timer timer, std::chrono::steady_clock::duration duration) {
+	Stat &stat = mTimers[unsigned(timer)];
+	uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+	stat.count++;
+	stat.total += ns;
+	uint64_t max = stat.max;
+	while (ns > max && !stat.max.compare_exchange_weak(max, ns))
+		;
+}
+
+std::string Metrics::Report() const {
+	static_assert(sizeof sNames / sizeof sNames[0] == unsigned(Timer::Num), "a name for every timer");
+	std::string report = "           count   total ms    mean ms     max ms\n";
+	for (unsigned i = 0; i < unsigned(Timer::Num); i++) {
+		const Stat &stat = mTimers[i];
+		uint64_t count = stat.count;
+		char line[100];
+		snprintf(line, sizeof line, "%-8s %7llu %10.1f %10.3f %10.3f\n", sNames[i], (unsigned long long)count, stat.total / 1e6,
+			count == 0 ? 0.0 : stat.total / 1e6 / count, stat.max / 1e6);
+		report += line;
+	}
+	return report;
+}
@@ -0,0 +1,64 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Time and amount of work done for a document, to find out where the time goes when it is slow.
+// Everything may be updated from any thread.
+class Metrics
+{
+public:
+	enum class Timer {
+		Read,    // Reading the file, by the worker thread
+		Split,   // Splitting data into lines, by the worker thread
+		Update,  // Taking care of new lines from the worker thread
+		Filter,  // Finding the lines that are shown
+		Append,  // Showing new lines, including the filter
+		Replace, // Showing all lines again, including the filter
+		Find,    // Find next, and the search for all rows while typing
+		Draw,    // Drawing the visible rows
+		Num
+	};
+	// Measure the time until the end of the scope
+	class Scope {
+	public:
+		Scope(Metrics &metrics, Timer timer) : mMetrics(metrics), mTimer(timer), mStart(std::chrono::steady_clock::now()) {}
+		~Scope() { mMetrics.Add(mTimer, std::chrono::steady_clock::now() - mStart); }
+	private:
+		Metrics &mMetrics;
+		Timer mTimer;
+		std::chrono::steady_clock::time_point mStart;
+	};
+
+	void Add(Timer, std::chrono::steady_clock::duration);
+	void AddBytes(uint64_t bytes) { mBytes += bytes; }
+	uint64_t Bytes() const { return mBytes; }
+	std::string Report() const; // A table of the timers, one line each
+
+private:
+	struct Stat {
+		std::atomic<uint64_t> count{0};
+		std::atomic<uint64_t> total{0}; // ns
+		std::atomic<uint64_t> max{0};   // ns
+	};
+	Stat mTimers[unsigned(Timer::Num)];
+	std::atomic<uint64_t> mBytes{0};
+};
@@ -0,0 +1,170 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <string.h>
+
+#include "Regex.h"
+#include "Debug.h"
+
+bool Regex::IsRegex(const std::string &pattern) {
+	return pattern.size() > 2 && End(pattern) == pattern.size() - 1;
+}
+
+size_t Regex::End(const std::string &pattern) {
+	if (pattern.empty() || pattern[0] != '/')
+		return std::string::npos;
+	for (size_t i = 1; i < pattern.size(); i++) {
+		if (pattern[i] == '\\')
+			i++; // An escaped character, which may be a '/'
+		else if (pattern[i] == '/')
+			return i;
+	}
+	return std::string::npos;
+}
+
+Regex::Regex(const std::string &pattern, bool caseSensitive) {
+	std::string expression = pattern.substr(1, pattern.size() - 2);
+	GError *error = nullptr;
+	int flags = G_REGEX_OPTIMIZE;
+	if (!caseSensitive)
+		flags |= G_REGEX_CASELESS;
+	GRegex *regex = g_regex_new(expression.c_str(), GRegexCompileFlags(flags), GRegexMatchFlags(0), &error);
+	if (regex == nullptr) {
+		LPLOG("'%s': %s", expression.c_str(), error->message);
+		g_error_free(error);
+		return;
+	}
+	mRegex.reset(regex, g_regex_unref);
+	if (caseSensitive && expression.find("(?") == std::string::npos) // Options may change what is a literal
+		mRequired = Finder(RequiredLiteral(expression), true, true);
+	LPLOG("'%s' requires '%s'", expression.c_str(), mRequired.str().c_str());
+}
+
+// Return the position of the ']' that ends the class starting at 'i', or npos
+static size_t ClassEnd(const std::string &expression, size_t i) {
+	i++;
+	if (i < expression.size() && expression[i] == '^')
+		i++;
+	if (i < expression.size() && expression[i] == ']')
+		i++; // A ']' first in a class is an ordinary character
+	for (; i < expression.size(); i++) {
+		if (expression[i] == '\\')
+			i++;
+		else if (expression[i] == ']')
+			return i;
+	}
+	return std::string::npos;
+}
+
+// Find the longest sequence of ordinary characters that is outside of groups, classes and alternatives.
+// Anything that isn't understood gives no string at all, as a string that isn't required would lose matches.
+std::string Regex::RequiredLiteral(const std::string &expression) {
+	std::string best, current;
+	auto EndSequence = [&]() {
+		if (current.size() > best.size())
+			best = current;
+		current.clear();
+	};
+	int depth = 0; // Groups
+	for (size_t i = 0; i < expression.size(); i++) {
+		char c = expression[i];
+		if (c == '[') {
+			i = ClassEnd(expression, i);
+			if (i == std::string::npos)
+				return "";
+			EndSequence();
+			continue;
+		}
+		if (c == '\\' && i + 1 < expression.size()) {
+			char next = expression[++i];
+			if (!g_ascii_isalnum(next)) {
+				if (depth == 0)
+					current += next; // An escaped punctuation character is itself
+				continue;
+			}
+			if (strchr("dDwWsSbB", next) == nullptr)
+				return ""; // Escapes that may be followed by arguments
+			EndSequence();
+			continue;
+		}
+		if (c == '(') {
+			depth++;
+			EndSequence();
+			continue;
+		}
+		if (c == ')') {
+			depth--;
+			continue;
+		}
+		if (depth > 0)
+			continue;
+		switch (c) {
+		case '|':
+			return ""; // Alternatives at the top level, nothing is required
+		case '*':
+		case '?':
+			// The previous character is optional
+			if (!current.empty())
+				current.pop_back();
+			EndSequence();
+			break;
+		case '{':
+			if (!current.empty())
+				current.pop_back();
+			EndSequence();
+			i = expression.find('}', i);
+			if (i == std::string::npos)
+				return "";
+			break;
+		case '+':
+			// The previous character is required, but may be repeated, unless another quantifier follows
+			if (i + 1 < expression.size() && strchr("*{", expression[i + 1]) != nullptr && !current.empty())
+				current.pop_back();
+			EndSequence();
+			break;
+		case '.':
+		case '^':
+		case '$':
+		case '\\':
+			EndSequence();
+			break;
+		default:
+			current += c;
+			break;
+		}
+	}
+	EndSequence();
+	return best;
+}
+
+bool Regex::Match(const char *p, size_t size, size_t *start, size_t *length, size_t from) const {
+	if (mRegex == nullptr || from > size)
+		return false;
+	if (!mRequired.str().empty() && mRequired.Find(p + from, size - from) == Finder::npos)
+		return false;
+	GMatchInfo *info = nullptr;
+	bool found = g_regex_match_full(mRegex.get(), p, size, from, GRegexMatchFlags(0), start != nullptr || length != nullptr ? &info : nullptr, nullptr);
+	if (found && info != nullptr) {
+		int from = 0, to = 0;
+		g_match_info_fetch_pos(info, 0, &from, &to);
+		if (start != nullptr)
+			*start = from;
+		if (length != nullptr)
+			*length = to - from;
+	}
+	if (info != nullptr)
+		g_match_info_free(info);
+	return found;
+}
@@ -0,0 +1,45 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <string>
+#include <memory>
+#include <glib.h>
+
+#include "Finder.h"
+
+// A regular expression, written as "/.../" in a pattern or a search.
+// It is compiled once, optimized (JIT when available). A literal string that every match must contain is
+// taken from the expression, and lines without it are rejected before the regular expression is used.
+// Matching is thread safe.
+class Regex
+{
+public:
+	static bool IsRegex(const std::string &pattern); // True if the pattern is written as a regular expression, "//" is not
+	static size_t End(const std::string &pattern); // The position of the last '/' of a regular expression first in 'pattern', or npos
+	// 'pattern' includes the slashes
+	Regex(const std::string &pattern, bool caseSensitive);
+	bool Valid() const { return mRegex != nullptr; }
+	const std::string &Required() const { return mRequired.str(); }
+	// Return true if there is a match. '*start' and '*length' are optional.
+	// The match is searched for from 'from', but the text before it is still seen by e.g. '^', '\b' and lookbehind.
+	bool Match(const char *, size_t size, size_t *start = nullptr, size_t *length = nullptr, size_t from = 0) const;
+
+private:
+	std::shared_ptr<GRegex> mRegex;
+	Finder mRequired; // Empty if nothing is known to be required
+	static std::string RequiredLiteral(const std::string &expression);
+};
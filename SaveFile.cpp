@@ -92,6 +92,8 @@ void SaveFile::Read(bool onlyPatterns) {
 }
 
 void SaveFile::Write() {
+	if (mReadOnly)
+		return;
 	const string path = GetPath();
 	std::ofstream output(path);
 	if (!output.is_open()) {
@@ -135,9 +137,11 @@ string SaveFile::GetStringOption(const string &id, const std::string &def) {
 	}
 	string key = sStringPrefix + id;
 	auto it = mData.find(key);
-	if (it == mData.end())
+	if (it != mData.end())
+		return it->second;
+	if (!mReadOnly)
 		mData[key] = def;
-	return mData[key];
+	return def;
 }
 
 void SaveFile::SetIntOption(const std::string &key, int val) {
@@ -155,9 +159,11 @@ int SaveFile::GetIntOption(const std::string &id, int def) {
 	}
 	string key = sNumberPrefix + id;
 	auto it = mData.find(key);
-	if (it == mData.end())
+	if (it != mData.end())
+		return stoi(it->second);
+	if (!mReadOnly)
 		mData[key] = to_string(def);
-	return stoi(mData[key]);
+	return def;
 }
 
 string SaveFile::GetPath() const {
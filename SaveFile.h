@@ -22,7 +22,8 @@
 class SaveFile
 {
 public:
-	SaveFile(const std::string &fn) : mFileName(fn) {}
+	// A read only save file is never written, and getting an option does not add its default value
+	SaveFile(const std::string &fn, bool readOnly = false) : mFileName(fn), mReadOnly(readOnly) {}
 	void Read(bool onlyPatterns = false); // Load a save file.
 	void Write();
 
@@ -39,6 +40,7 @@ public:
 	void IteratePatterns(std::function<void (const std::string &name, const std::string &value)>);
 private:
 	const std::string mFileName;
+	const bool mReadOnly;
 	std::map<std::string, std::string> mData;
 	std::string GetPath() const;
 	static bool IsValidKey(const std::string &);
@@ -0,0 +1,106 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <algorithm>
+
+#include "SearchJob.h"
+#include "Document.h"
+#include "ThreadPool.h"
+#include "Debug.h"
+
+void SearchJob::Start(const Finder &finder, Document *doc) {
+	if (doc == mDoc && finder.Includes(mFinder)) {
+		// Rows found are before those that remain to be tested, so the order is kept
+		std::vector<unsigned> candidates = std::move(mRows);
+		candidates.insert(candidates.end(), mCandidates.begin() + mNextCandidate, mCandidates.end());
+		mCandidates = std::move(candidates);
+	} else {
+		mCandidates.clear();
+		mScanned = 0;
+	}
+	LPLOG("'%s' %u candidates, %u rows tested", finder.str().c_str(), (unsigned)mCandidates.size(), mScanned);
+	mRows.clear();
+	mNextCandidate = 0;
+	mFinder = finder;
+	mDoc = doc;
+}
+
+void SearchJob::Restart() {
+	mRows.clear();
+	mCandidates.clear();
+	mNextCandidate = 0;
+	mScanned = 0;
+}
+
+void SearchJob::RemoveRows(unsigned rows) {
+	auto Remove = [rows](std::vector<unsigned> &v, unsigned from) {
+		auto it = std::lower_bound(v.begin() + from, v.end(), rows);
+		v.erase(v.begin(), it);
+		for (auto &row : v)
+			row -= rows;
+	};
+	Remove(mRows, 0);
+	Remove(mCandidates, mNextCandidate);
+	mNextCandidate = 0;
+	mScanned = mScanned > rows ? mScanned - rows : 0;
+}
+
+void SearchJob::Cancel() {
+	Restart();
+	mFinder = Finder();
+	mDoc = nullptr;
+}
+
+bool SearchJob::Done() const {
+	return mDoc == nullptr || (mNextCandidate == mCandidates.size() && mScanned >= mDoc->GetNumShownLines());
+}
+
+bool SearchJob::Step(ThreadPool &pool) {
+	if (Done())
+		return false;
+	mDoc->ValidateLines();
+	unsigned maxRows = cRowsPerChunk * cChunksPerThread * pool.size();
+	if (mNextCandidate < mCandidates.size()) {
+		unsigned count = std::min<size_t>(maxRows, mCandidates.size() - mNextCandidate);
+		const unsigned *rows = &mCandidates[mNextCandidate];
+		Test(pool, count, [rows](unsigned i) { return rows[i]; });
+		mNextCandidate += count;
+		if (mNextCandidate == mCandidates.size()) {
+			mCandidates.clear();
+			mNextCandidate = 0;
+		}
+	} else {
+		unsigned first = mScanned;
+		unsigned count = std::min(maxRows, mDoc->GetNumShownLines() - first);
+		Test(pool, count, [first](unsigned i) { return first + i; });
+		mScanned += count;
+	}
+	return !Done();
+}
+
+void SearchJob::Test(ThreadPool &pool, unsigned count, const std::function<unsigned (unsigned)> &row) {
+	unsigned numChunks = (count + cRowsPerChunk - 1) / cRowsPerChunk;
+	std::vector<std::vector<unsigned>> found(numChunks);
+	pool.ParallelFor(numChunks, [&](unsigned chunk) {
+		unsigned last = std::min(count, (chunk + 1) * cRowsPerChunk);
+		for (unsigned i = chunk * cRowsPerChunk; i < last; i++) {
+			unsigned lineNumber;
+			if (mFinder.Find(mDoc->GetShownLine(row(i), &lineNumber)) != Finder::npos)
+				found[chunk].push_back(row(i));
+		}
+	});
+	for (auto &rows : found)
+		mRows.insert(mRows.end(), rows.begin(), rows.end());
+}
@@ -0,0 +1,56 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <vector>
+#include <functional>
+
+#include "Finder.h"
+
+class Document;
+class ThreadPool;
+
+// Find all shown rows of a document that contain a string.
+// The rows are tested a part at a time, from the main loop, so that the search can be replaced by a new one
+// for every key typed. Rows are only read by the main thread and the thread pool while the main thread waits,
+// as the lines of a document may change between steps.
+class SearchJob
+{
+public:
+	// Start a new search. If it is the same document, and every line with the new string also contains the
+	// string of the previous search, only the rows found by that search need to be tested again.
+	void Start(const Finder &, Document *);
+	void Restart(); // All rows were replaced
+	void RemoveRows(unsigned rows); // The first rows were removed, the rest keep their results
+	void Cancel();
+	bool Active(const Document *doc) const { return doc != nullptr && doc == mDoc; }
+	// Test the next part of the rows. Return true if there is more to do.
+	bool Step(ThreadPool &);
+	bool Done() const;
+	const Finder &GetFinder() const { return mFinder; }
+	const std::vector<unsigned> &Rows() const { return mRows; } // Rows found so far, in increasing order
+
+private:
+	Finder mFinder;
+	Document *mDoc = nullptr;
+	std::vector<unsigned> mRows;
+	std::vector<unsigned> mCandidates; // Rows before mScanned that remain to be tested
+	unsigned mNextCandidate = 0;
+	unsigned mScanned = 0;             // Rows from here have not been tested at all
+	static const unsigned cRowsPerChunk = 16384;
+	static const unsigned cChunksPerThread = 4; // Chunks in one step
+	void Test(ThreadPool &, unsigned count, const std::function<unsigned (unsigned)> &row);
+};
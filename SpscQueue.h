@@ -0,0 +1,60 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+// A lock free queue with a fixed capacity, for exactly one producer thread and one consumer thread.
+// One slot is always kept empty, to tell a full queue from an empty one.
+template<typename T, unsigned N>
+class SpscQueue
+{
+public:
+	// Return false if the queue is full. 'item' is then left unchanged.
+	bool Push(T &&item) {
+		unsigned tail = mTail.load(std::memory_order_relaxed);
+		unsigned next = (tail + 1) % N;
+		if (next == mHead.load(std::memory_order_acquire))
+			return false;
+		mItems[tail] = std::move(item);
+		mTail.store(next, std::memory_order_release);
+		return true;
+	}
+
+	// Return false if the queue is empty.
+	bool Pop(T &item) {
+		unsigned head = mHead.load(std::memory_order_relaxed);
+		if (head == mTail.load(std::memory_order_acquire))
+			return false;
+		item = std::move(mItems[head]);
+		mHead.store((head + 1) % N, std::memory_order_release);
+		return true;
+	}
+
+	bool Empty() const { return mHead.load(std::memory_order_acquire) == mTail.load(std::memory_order_acquire); }
+
+private:
+	// The head and the tail are written by different threads, and are kept on cache lines of their own with
+	// padding. alignas() would make the class over-aligned, which operator new doesn't honour before C++17.
+	static const unsigned cCacheLine = 64;
+	T mItems[N];
+	char mPadItems[cCacheLine];
+	std::atomic<unsigned> mHead{0}; // Only changed by the consumer
+	char mPadHead[cCacheLine - sizeof(std::atomic<unsigned>)];
+	std::atomic<unsigned> mTail{0}; // Only changed by the producer
+	char mPadTail[cCacheLine - sizeof(std::atomic<unsigned>)];
+};
@@ -0,0 +1,128 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include <string.h>
+#include <algorithm>
+
+#include "StringSearch.h"
+#include "LineStore.h"
+#include "Debug.h"
+
+void StringSearch::Clear() {
+	mNeedles.clear();
+	mRegexes.clear();
+	mAutomaton.Clear();
+}
+
+// A rough estimate of how common a character is in log files. Lower means less common.
+static unsigned Frequency(unsigned char c) {
+	if (c == ' ')
+		return 10;
+	if (strchr("etaoinsrlcdu", c) != nullptr)
+		return 8;
+	if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9'))
+		return 6;
+	if (strchr(":.-_/=,[]()", c) != nullptr)
+		return 5;
+	if (c >= 'A' && c <= 'Z')
+		return 3;
+	return 1;
+}
+
+unsigned StringSearch::Add(const std::string &str) {
+	auto it = std::find_if(mNeedles.begin(), mNeedles.end(), [&str](const Needle &needle) { return needle.str == str; });
+	if (it != mNeedles.end())
+		return it - mNeedles.begin();
+	Needle needle = { str, 0, nullptr };
+	for (unsigned i = 1; i < str.size(); i++) {
+		if (Frequency(str[i]) < Frequency(str[needle.anchor]))
+			needle.anchor = i;
+	}
+	if (Regex::IsRegex(str)) {
+		needle.regex = std::make_shared<Regex>(str, true);
+		if (!needle.regex->Valid()) {
+			LPLOG("'%s' is searched for as a string", str.c_str());
+			needle.regex.reset();
+		}
+	}
+	mNeedles.push_back(needle);
+	return mNeedles.size() - 1;
+}
+
+unsigned StringSearch::Add(const StringSearch &other, unsigned i) {
+	const Needle &needle = other.mNeedles[i];
+	auto it = std::find_if(mNeedles.begin(), mNeedles.end(), [&needle](const Needle &n) { return n.str == needle.str; });
+	if (it != mNeedles.end())
+		return it - mNeedles.begin();
+	mNeedles.push_back(needle);
+	return mNeedles.size() - 1;
+}
+
+void StringSearch::Prepare() {
+	mAutomaton.Clear();
+	mRegexes.clear();
+	for (unsigned i = 0; i < mNeedles.size(); i++) {
+		if (mNeedles[i].regex != nullptr)
+			mRegexes.push_back(i);
+	}
+	if (mNeedles.size() < cMinAutomaton)
+		return;
+	// A regular expression is represented by the string it requires, and tested when that is found
+	std::vector<std::string> strings;
+	for (auto &needle : mNeedles)
+		strings.push_back(needle.regex != nullptr ? needle.regex->Required() : needle.str);
+	mAutomaton.Build(strings);
+}
+
+void StringSearch::FindAll(const LineRef &line, uint64_t *found) const {
+	if (UsesAutomaton()) {
+		mAutomaton.Search(line.data, line.size, found);
+		for (unsigned i : mRegexes) {
+			uint64_t bit = uint64_t(1) << (i % 64);
+			if ((found[i / 64] & bit) && !mNeedles[i].regex->Match(line.data, line.size))
+				found[i / 64] &= ~bit;
+		}
+		return;
+	}
+	for (unsigned i = 0; i < mNeedles.size(); i++) {
+		if (Contains(line, i))
+			found[i / 64] |= uint64_t(1) << (i % 64);
+	}
+}
+
+// Candidates are found by searching for the anchor character.
+bool StringSearch::Contains(const LineRef &line, unsigned i) const {
+	const Needle &needle = mNeedles[i];
+	if (needle.regex != nullptr)
+		return needle.regex->Match(line.data, line.size);
+	size_t len = needle.str.size();
+	if (len > line.size)
+		return false;
+	if (len == 0)
+		return true;
+	const char *str = needle.str.data();
+	char anchor = str[needle.anchor];
+	// The anchor can't be found after 'last' in a match
+	const char *last = line.data + line.size - len + needle.anchor;
+	for (const char *p = line.data + needle.anchor; p <= last; p++) {
+		p = (const char *)memchr(p, anchor, last - p + 1);
+		if (p == nullptr)
+			return false;
+		if (memcmp(p - needle.anchor, str, len) == 0)
+			return true;
+	}
+	return false;
+}
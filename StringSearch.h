@@ -0,0 +1,60 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <memory>
+
+#include "AhoCorasick.h"
+#include "Regex.h"
+
+struct LineRef;
+
+// A set of strings to search for in lines.
+// When there are many strings, all of them are searched for in one pass over the line.
+// A string written as "/.../" is a regular expression. The literal string it requires is then searched for in
+// the same pass, and the regular expression is only tested in lines where it was found.
+class StringSearch
+{
+public:
+	void Clear();
+	unsigned Add(const std::string &); // Return the index. The same string is only added once.
+	unsigned Add(const StringSearch &, unsigned i); // Add a string of another search, without compiling it again
+	void Prepare();                    // Call when all strings have been added
+	unsigned size() const { return mNeedles.size(); }
+	const std::string &operator[](unsigned i) const { return mNeedles[i].str; }
+	// True if FindAll() is faster than testing the strings one at a time.
+	bool UsesAutomaton() const { return !mAutomaton.Empty(); }
+	bool Contains(const LineRef &, unsigned i) const;
+	// Set bit 'i' in 'found' for every string 'i' that is in the line. 'found' shall have Words() words, cleared.
+	void FindAll(const LineRef &, uint64_t *found) const;
+	unsigned Words() const { return (mNeedles.size() + 63) / 64; }
+
+private:
+	// A string to search for, prepared with the byte that is least likely to be found.
+	struct Needle {
+		std::string str;
+		unsigned anchor;
+		std::shared_ptr<Regex> regex; // Unless it is a literal string
+	};
+	std::vector<Needle> mNeedles;
+	std::vector<unsigned> mRegexes; // Needles that are regular expressions
+	static const unsigned cMinAutomaton = 8; // Fewer strings are faster to search for one at a time
+	AhoCorasick mAutomaton;
+};
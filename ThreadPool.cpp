@@ -0,0 +1,123 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include <algorithm>
+
+#include "ThreadPool.h"
+#include "Debug.h"
+
+ThreadPool::ThreadPool(unsigned numThreads) {
+	if (numThreads == 0)
+		numThreads = std::max(1u, std::thread::hardware_concurrency());
+	for (unsigned i = 0; i < numThreads; i++)
+		mQueues.emplace_back(new Queue);
+	for (unsigned i = 1; i < numThreads; i++)
+		mThreads.emplace_back(&ThreadPool::Worker, this, i);
+	LPLOG("%u threads", numThreads);
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+	}
+	mWake.notify_all();
+	for (auto &thread : mThreads)
+		thread.join();
+}
+
+void ThreadPool::ParallelFor(unsigned count, const std::function<void (unsigned)> &f) {
+	if (count == 0)
+		return;
+	if (count == 1) {
+		f(0); // Not worth waking up the other threads
+		return;
+	}
+	unsigned numQueues = mQueues.size();
+	// Every thread starts with a consecutive range of parts
+	for (unsigned id = 0; id < numQueues; id++) {
+		Queue &queue = *mQueues[id];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		for (unsigned i = uint64_t(count) * id / numQueues; i < uint64_t(count) * (id + 1) / numQueues; i++)
+			queue.items.push_back(i);
+	}
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mJob = &f;
+		mRemaining = count;
+		mGeneration++;
+	}
+	mWake.notify_all();
+	this->Run(0, f);
+	std::unique_lock<std::mutex> lock(mMutex);
+	// Wait for the other threads to stop looking for parts too, or they could take parts of the next job.
+	mDone.wait(lock, [this]() { return mRemaining == 0 && mActive == 0; });
+	mJob = nullptr;
+}
+
+void ThreadPool::Worker(unsigned id) {
+	unsigned generation = 0;
+	std::unique_lock<std::mutex> lock(mMutex);
+	for (;;) {
+		mWake.wait(lock, [&]() { return mQuit || (mGeneration != generation && mJob != nullptr); });
+		if (mQuit)
+			return;
+		generation = mGeneration;
+		const std::function<void (unsigned)> &f = *mJob;
+		mActive++;
+		lock.unlock();
+		this->Run(id, f);
+		lock.lock();
+		if (--mActive == 0 && mRemaining == 0)
+			mDone.notify_one();
+	}
+}
+
+void ThreadPool::Run(unsigned id, const std::function<void (unsigned)> &f) {
+	unsigned item, done = 0;
+	while (this->Take(id, item)) {
+		f(item);
+		done++;
+	}
+	if (done == 0)
+		return;
+	std::lock_guard<std::mutex> lock(mMutex);
+	mRemaining -= done;
+	if (mRemaining == 0 && mActive == 0)
+		mDone.notify_one();
+}
+
+bool ThreadPool::Take(unsigned id, unsigned &item) {
+	{
+		Queue &own = *mQueues[id];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.items.empty()) {
+			item = own.items.front();
+			own.items.pop_front();
+			return true;
+		}
+	}
+	for (unsigned i = 1; i < mQueues.size(); i++) {
+		Queue &other = *mQueues[(id + i) % mQueues.size()];
+		std::lock_guard<std::mutex> lock(other.mutex);
+		if (!other.items.empty()) {
+			item = other.items.back();
+			other.items.pop_back();
+			return true;
+		}
+	}
+	return false;
+}
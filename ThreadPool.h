@@ -0,0 +1,62 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// A fixed set of threads, used to do one job split into independent parts.
+// Every thread has its own queue of parts. When it is empty, parts are stolen from the other end
+// of another queue, which balances the load when some parts take longer than others.
+class ThreadPool
+{
+public:
+	explicit ThreadPool(unsigned numThreads = 0); // Default is one thread for every core
+	~ThreadPool();
+	unsigned size() const { return mQueues.size(); } // Including the calling thread
+	// Call 'f' for every number in [0, count), and wait until all are done. The calling thread also takes part.
+	// Only one thread may use this at a time.
+	void ParallelFor(unsigned count, const std::function<void (unsigned)> &f);
+
+private:
+	struct Queue {
+		std::mutex mutex;
+		std::deque<unsigned> items;
+	};
+	std::vector<std::unique_ptr<Queue>> mQueues; // One for each thread, where the calling thread is number 0
+	std::vector<std::thread> mThreads;
+
+	std::mutex mMutex;
+	std::condition_variable mWake;
+	std::condition_variable mDone;
+	const std::function<void (unsigned)> *mJob = nullptr; // Protected by mMutex
+	unsigned mGeneration = 0;                             // Protected by mMutex, counts jobs
+	unsigned mRemaining = 0;                              // Protected by mMutex
+	unsigned mActive = 0;                                 // Protected by mMutex, threads working on the job
+	bool mQuit = false;                                   // Protected by mMutex
+
+	void Worker(unsigned id);
+	bool Take(unsigned id, unsigned &item); // Take from the own queue first, then steal
+	void Run(unsigned id, const std::function<void (unsigned)> &f);
+
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+};
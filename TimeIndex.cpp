@@ -0,0 +1,117 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include <algorithm>
+
+#include "TimeIndex.h"
+
+namespace {
+
+const Timestamp::Time cHalfYear = 183 * Timestamp::cDay;
+
+}
+
+Timestamp::Time TimeIndex::InYear(Timestamp::Time time, int *years, Timestamp::Time last) {
+	if (!Timestamp::WithoutYear(time))
+		return time;
+	Timestamp::Time inYear = Timestamp::AddYears(time, *years);
+	if (last != Timestamp::cNone && inYear < last - cHalfYear)
+		inYear = Timestamp::AddYears(time, ++*years);
+	return inYear;
+}
+
+void TimeIndex::Add(Timestamp::Time time) {
+	time = InYear(time, &mYears, this->Last());
+	if (time != Timestamp::cNone && time < this->Last())
+		mClamped++;
+	mTimes.push_back(mTimes.empty() ? time : std::max(time, mTimes.back()));
+}
+
+void TimeIndex::Prepend(const std::vector<Timestamp::Time> &times) {
+	// The years are found as if the lines were added, starting from no years
+	std::vector<Timestamp::Time> head;
+	head.reserve(times.size());
+	int years = 0;
+	Timestamp::Time last = Timestamp::cNone;
+	bool lastWithoutYear = false;
+	for (auto time : times) {
+		head.push_back(InYear(time, &years, last));
+		if (head.back() != Timestamp::cNone && head.back() < last)
+			mClamped++;
+		if (head.back() > last) {
+			last = head.back();
+			lastWithoutYear = Timestamp::WithoutYear(time);
+		}
+	}
+	// Then moved to the years before the lines that follow, which are not changed
+	auto next = std::lower_bound(mTimes.begin(), mTimes.end(), Timestamp::cNone + 1);
+	if (lastWithoutYear && next != mTimes.end()) {
+		int shift = 0;
+		while (Timestamp::AddYears(last, shift) - cHalfYear > *next)
+			shift--;
+		for (unsigned i = 0; i < times.size() && shift != 0; i++) {
+			if (Timestamp::WithoutYear(times[i]))
+				head[i] = Timestamp::AddYears(head[i], shift);
+		}
+		last = Timestamp::AddYears(last, shift);
+	}
+	// The lines that follow can only be changed up to the first one that has a later time
+	for (auto it = mTimes.begin(); it != mTimes.end() && *it < last; ++it) {
+		if (*it != Timestamp::cNone)
+			mClamped++;
+		*it = last;
+	}
+	for (auto it = head.rbegin(); it != head.rend(); ++it)
+		mTimes.push_front(*it);
+	// Now in the order of the lines
+	for (auto it = mTimes.begin() + 1; it < mTimes.begin() + times.size(); ++it)
+		*it = std::max(*it, it[-1]);
+}
+
+void TimeIndex::Evict(unsigned first) {
+	if (first <= mFirst)
+		return;
+	mTimes.erase(mTimes.begin(), mTimes.begin() + std::min(size_t(first - mFirst), mTimes.size()));
+	mFirst = first;
+}
+
+unsigned TimeIndex::Find(Timestamp::Time time, unsigned first, unsigned last) const {
+	return std::lower_bound(mTimes.begin() + (first - mFirst), mTimes.begin() + (last - mFirst), time) - mTimes.begin() + mFirst;
+}
+
+LineSet TimeIndex::Select(Timestamp::Time from, Timestamp::Time to, bool timeOfDay, unsigned first, unsigned last) const {
+	if (!timeOfDay)
+		return LineSet::Range(this->Find(from, first, last), this->Find(to, first, last));
+	LineSet lines;
+	unsigned start = this->Find(Timestamp::cNone + 1, first, last); // Lines before that have no time
+	if (start == last)
+		return lines;
+	if (to <= from)
+		to += Timestamp::cDay; // Until the next day
+	// A range that includes midnight starts the day before
+	for (int64_t day = Timestamp::Day((*this)[start]) - 1, lastDay = Timestamp::Day((*this)[last - 1]); day <= lastDay; ) {
+		unsigned begin = this->Find(day * Timestamp::cDay + from, start, last);
+		unsigned end = this->Find(day * Timestamp::cDay + to, begin, last);
+		if (begin < end)
+			lines.Append(LineSet::Range(begin, end));
+		if (end == last)
+			break;
+		// Skip the days without lines. The range of the day before may include the lines after midnight.
+		day = std::max(day + 1, Timestamp::Day((*this)[end]) - 1);
+		start = end;
+	}
+	return lines;
+}
@@ -0,0 +1,60 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <cstddef>
+
+#include "Timestamp.h"
+#include "LineSet.h"
+
+// The time of every line of a document, in a column next to the lines, to find lines by time with a binary search.
+// The times never decrease: a line without a time stamp, or with an earlier time than the line before, has the time
+// of the line before. Such lines are counted, see Clamped(). Lines before the first time stamp have Timestamp::cNone.
+// A time stamp without a year, e.g. from syslog, is in the year of the line before. If that takes the time back by
+// more than half a year, it is in the year after instead, as when a log goes from December to January.
+class TimeIndex
+{
+public:
+	void Clear() { mTimes.clear(); mFirst = 0; mYears = 0; mClamped = 0; }
+	void Add(Timestamp::Time); // The time stamp of the next line, or cNone if it has none
+	// Add the time stamps of lines that are moved to before all other lines, see LineStore::MoveToFront()
+	void Prepend(const std::vector<Timestamp::Time> &);
+	void Evict(unsigned first); // Forget the lines before 'first'
+	Timestamp::Time operator[](unsigned line) const { return mTimes[line - mFirst]; }
+	unsigned size() const { return mFirst + mTimes.size(); } // Including lines evicted
+	unsigned First() const { return mFirst; }
+	Timestamp::Time Last() const { return mTimes.empty() ? Timestamp::cNone : mTimes.back(); } // The latest time
+	// The first line from 'first' to 'last' that has the time or later, or 'last' if there is none
+	unsigned Find(Timestamp::Time, unsigned first, unsigned last) const;
+	// The lines from 'first' to 'last' that have a time from 'from' up to, but not including, 'to'. For a time
+	// of day, 'from' and 'to' are times since midnight, and lines are selected on every day. 'to' may then be
+	// before 'from', for a range that includes midnight.
+	LineSet Select(Timestamp::Time from, Timestamp::Time to, bool timeOfDay, unsigned first, unsigned last) const;
+	size_t MemoryUsage() const { return mTimes.size() * sizeof(Timestamp::Time); }
+	unsigned Clamped() const { return mClamped; } // The number of lines that had an earlier time than a line before
+
+private:
+	std::deque<Timestamp::Time> mTimes;
+	unsigned mFirst = 0;   // Line number of mTimes[0]
+	int mYears = 0;        // Added to times without a year, one for every new year found
+	unsigned mClamped = 0;
+
+	// Move a time without a year to the year of 'last', or the year after, see above
+	static Timestamp::Time InYear(Timestamp::Time, int *years, Timestamp::Time last);
+};
@@ -0,0 +1,249 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <cstring>
+
+#include "Timestamp.h"
+
+const Timestamp::Time Timestamp::cNone;
+const Timestamp::Time Timestamp::cMax;
+const Timestamp::Time Timestamp::cSecond;
+const Timestamp::Time Timestamp::cDay;
+const char *const Timestamp::cDefaultFormat = "%Y-%m-%d %H:%M:%S|%Y-%m-%dT%H:%M:%S|%b %d %H:%M:%S";
+
+namespace {
+
+// Days since 1970-01-01 of a date in the proleptic Gregorian calendar
+int64_t DaysFromCivil(int64_t y, unsigned m, unsigned d) {
+	y -= m <= 2;
+	int64_t era = (y >= 0 ? y : y - 399) / 400;
+	unsigned yoe = unsigned(y - era * 400);
+	unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + int64_t(doe) - 719468;
+}
+
+// The date of a number of days since 1970-01-01, the inverse of DaysFromCivil()
+void CivilFromDays(int64_t days, int64_t *y, unsigned *m, unsigned *d) {
+	days += 719468;
+	int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+	unsigned doe = unsigned(days - era * 146097);
+	unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	unsigned mp = (5 * doy + 2) / 153;
+	*d = doy - (153 * mp + 2) / 5 + 1;
+	*m = mp < 10 ? mp + 3 : mp - 9;
+	*y = int64_t(yoe) + era * 400 + (*m <= 2);
+}
+
+// Read at least one and at most 'max' digits
+bool Number(const char *&p, const char *end, unsigned max, unsigned *value) {
+	unsigned n = 0;
+	*value = 0;
+	for (; p < end && n < max && *p >= '0' && *p <= '9'; p++, n++)
+		*value = *value * 10 + unsigned(*p - '0');
+	return n > 0;
+}
+
+// Decimals after the seconds, if there are any. Return the number of digits.
+unsigned Fraction(const char *&p, const char *end, unsigned *micro) {
+	*micro = 0;
+	if (p + 1 >= end || (*p != '.' && *p != ',') || p[1] < '0' || p[1] > '9')
+		return 0;
+	p++;
+	unsigned digits = 0;
+	for (; p < end && *p >= '0' && *p <= '9'; p++, digits++) {
+		if (digits < 6)
+			*micro = *micro * 10 + unsigned(*p - '0');
+	}
+	for (unsigned i = digits; i < 6; i++)
+		*micro *= 10;
+	return digits;
+}
+
+}
+
+Timestamp::Timestamp(const std::string &format) : mFormat(format) {
+	mFormats.emplace_back();
+	for (const char *f = format.c_str(); *f != 0; f++) {
+		if (*f == '|')
+			mFormats.emplace_back();
+		else if (*f == '%' && f[1] == '%')
+			mFormats.back().push_back(Field{*++f, true});
+		else if (*f == '%' && f[1] != 0)
+			mFormats.back().push_back(Field{*++f, false});
+		else
+			mFormats.back().push_back(Field{*f, *f != ' '});
+	}
+}
+
+bool Timestamp::Parse(const char *line, unsigned size, Time *time, unsigned *length) const {
+	if (Parse(mFormats[mLastFormat], line, size, time, length))
+		return true;
+	for (unsigned i = 0; i < mFormats.size(); i++) {
+		if (i != mLastFormat && Parse(mFormats[i], line, size, time, length)) {
+			mLastFormat = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool Timestamp::Parse(const std::vector<Field> &format, const char *line, unsigned size, Time *time, unsigned *length) const {
+	static const char cMonths[] = "janfebmaraprmayjunjulaugsepoctnovdec";
+	const char *p = line, *end = line + size;
+	unsigned year = 1970, month = 1, day = 1, hour = 0, minute = 0, second = 0;
+	unsigned micro = 0;
+	int64_t epoch = -1;
+	for (auto &field : format) {
+		if (field.literal) {
+			if (p == end || *p != field.code)
+				return false;
+			p++;
+			continue;
+		}
+		bool ok = true;
+		switch (field.code) {
+		case ' ':
+			ok = p < end && *p == ' ';
+			while (p < end && *p == ' ')
+				p++;
+			break;
+		case 'Y':
+			ok = Number(p, end, 4, &year);
+			break;
+		case 'm':
+			ok = Number(p, end, 2, &month) && month >= 1 && month <= 12;
+			break;
+		case 'd':
+			ok = Number(p, end, 2, &day) && day >= 1 && day <= 31;
+			break;
+		case 'H':
+			ok = Number(p, end, 2, &hour) && hour < 24;
+			break;
+		case 'M':
+			ok = Number(p, end, 2, &minute) && minute < 60;
+			break;
+		case 'T':
+			ok = Number(p, end, 2, &hour) && hour < 24 && p < end && *p++ == ':' &&
+				Number(p, end, 2, &minute) && minute < 60 && p < end && *p++ == ':';
+			// Fall through to the seconds
+		case 'S':
+			ok = ok && Number(p, end, 2, &second) && second <= 60;
+			if (ok)
+				Fraction(p, end, &micro);
+			break;
+		case 's': {
+			const char *start = p;
+			for (epoch = 0; p < end && p - start < 12 && *p >= '0' && *p <= '9'; p++)
+				epoch = epoch * 10 + (*p - '0');
+			ok = p - start >= 9;
+			if (ok)
+				Fraction(p, end, &micro);
+			break;
+		}
+		case 'b':
+			ok = false;
+			for (unsigned i = 0; end - p >= 3 && i < 12 && !ok; i++) {
+				ok = (p[0] | 0x20) == cMonths[i*3] && (p[1] | 0x20) == cMonths[i*3+1] && (p[2] | 0x20) == cMonths[i*3+2];
+				month = i + 1;
+			}
+			p += ok ? 3 : 0;
+			break;
+		default:
+			return false; // Not supported
+		}
+		if (!ok)
+			return false;
+	}
+	int64_t seconds = DaysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+	if (epoch >= 0)
+		seconds = epoch;
+	*time = seconds * cSecond + micro;
+	if (length != nullptr)
+		*length = unsigned(p - line);
+	return true;
+}
+
+Timestamp::Time Timestamp::AddYears(Time time, int years) {
+	int64_t day = Day(time), y;
+	unsigned m, d;
+	CivilFromDays(day, &y, &m, &d);
+	return time + (DaysFromCivil(y + years, m, d) - day) * cDay;
+}
+
+bool Timestamp::ParseUser(const std::string &str, Time *time, Time *unit, bool *timeOfDay) {
+	const char *p = str.c_str(), *end = p + str.size();
+	while (p < end && *p == ' ')
+		p++;
+	while (end > p && end[-1] == ' ')
+		end--;
+	unsigned micro = 0, digits;
+	// Seconds since 1970
+	const char *q = p;
+	int64_t seconds = 0;
+	for (; q < end && q - p < 12 && *q >= '0' && *q <= '9'; q++)
+		seconds = seconds * 10 + (*q - '0');
+	if (q - p >= 9) {
+		digits = Fraction(q, end, &micro);
+		if (q != end)
+			return false;
+		*time = seconds * cSecond + micro;
+		*unit = cSecond;
+		for (unsigned i = 0; i < digits && i < 6; i++)
+			*unit /= 10;
+		*timeOfDay = false;
+		return true;
+	}
+	// The date, if there is one
+	int64_t days = 0;
+	unsigned year = 0, month = 0, day = 0;
+	*timeOfDay = true;
+	q = p;
+	if (Number(q, end, 4, &year) && q - p == 4 && q < end && *q == '-') {
+		q++;
+		if (!Number(q, end, 2, &month) || month < 1 || month > 12 || q == end || *q++ != '-' ||
+			!Number(q, end, 2, &day) || day < 1 || day > 31)
+			return false;
+		days = DaysFromCivil(year, month, day);
+		*timeOfDay = false;
+		p = q;
+		if (p == end) {
+			*time = days * cDay;
+			*unit = cDay;
+			return true;
+		}
+		if (*p != ' ' && *p != 'T')
+			return false;
+		p++;
+	}
+	unsigned hour, minute, second = 0;
+	if (!Number(p, end, 2, &hour) || hour >= 24 || p == end || *p++ != ':' || !Number(p, end, 2, &minute) || minute >= 60)
+		return false;
+	*unit = 60 * cSecond;
+	if (p < end && *p == ':') {
+		p++;
+		if (!Number(p, end, 2, &second) || second > 60)
+			return false;
+		digits = Fraction(p, end, &micro);
+		*unit = cSecond;
+		for (unsigned i = 0; i < digits && i < 6; i++)
+			*unit /= 10;
+	}
+	if (p != end)
+		return false;
+	*time = days * cDay + ((hour * 60 + minute) * 60 + second) * cSecond + micro;
+	return true;
+}
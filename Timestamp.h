@@ -0,0 +1,69 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "LineStore.h"
+
+// The time stamp at the start of a line, e.g. "2024-01-01 12:00:00.123".
+// The format is in the style of strftime(): %Y, %m, %d, %H, %M, %S, %b (month name) and %T (%H:%M:%S) are fields,
+// and other characters have to be the same. A space matches one or more spaces, which lines up days like "Jan  1".
+// %s is the number of seconds since 1970, at least 9 digits, as used by e.g. the audit log.
+// Decimals after the seconds, with a '.' or a ',', are part of the time.
+// Several formats are separated by '|', e.g. ISO 8601 and syslog. They are tried in order, starting with the
+// format that was found last, as the lines of a file almost always use the same one.
+// A time is the number of microseconds since 1970, without any time zone. Fields that are not in the format are
+// the same for all lines, e.g. the year of a syslog line is 1970. See TimeIndex for how a new year is found.
+class Timestamp
+{
+public:
+	typedef int64_t Time;
+	static const Time cNone = INT64_MIN; // Before all times
+	static const Time cMax = INT64_MAX;  // After all times
+	static const Time cSecond = 1000000;
+	static const Time cDay = 86400 * cSecond;
+	static const char *const cDefaultFormat;
+
+	explicit Timestamp(const std::string &format = cDefaultFormat);
+	const std::string &Format() const { return mFormat; }
+	// Find the time at the start of the line. Return false if there is none. The number of characters used
+	// is returned in '*length', if given.
+	bool Parse(const char *, unsigned size, Time *, unsigned *length = nullptr) const;
+	bool Parse(const LineRef &line, Time *time) const { return Parse(line.data, line.size, time); }
+
+	// A time typed by the user, e.g. "2024-01-01 14:02:30.5", "2024-01-01T14:02", "2024-01-01", "14:02" or
+	// "1700000000". A time of day without a date is the time since midnight, and '*timeOfDay' is set.
+	// '*unit' is the length of the last field given, e.g. a minute for "14:02", to be able to include all of it.
+	static bool ParseUser(const std::string &, Time *time, Time *unit, bool *timeOfDay);
+	static int64_t Day(Time time) { return time >= 0 ? time / cDay : -((-(time + 1)) / cDay) - 1; } // Days since 1970
+	static bool WithoutYear(Time time) { return time >= 0 && time < 365 * cDay; } // In 1970, from a format without %Y
+	static Time AddYears(Time, int years); // The same date and time of day, in another year
+
+private:
+	std::string mFormat;
+	// The formats are split at '|', and into fields, which are the letters after '%', or ' ' or a character
+	// that has to be the same
+	struct Field {
+		char code;
+		bool literal;
+	};
+	std::vector<std::vector<Field>> mFormats;
+	mutable unsigned mLastFormat = 0; // The format that was found last
+	bool Parse(const std::vector<Field> &, const char *, unsigned size, Time *, unsigned *length) const;
+};
@@ -16,11 +16,14 @@
 #include <string.h>
 #include <iostream>
 #include <stdlib.h>
+#include <stdio.h>
 #include <algorithm>
 #include <gdk/gdkkeysyms.h> // Needed for GTK+-2.0
 
 #include "Document.h"
 #include "View.h"
+#include "LogView.h"
+#include "Regex.h"
 #include "PatternTable.h"
 #include "Defer.h"
 #include "SaveFile.h"
@@ -67,6 +70,9 @@ void View::Create(GdkPixbuf *icon, GCallback buttonCB, GCallback toggleButtonCB,
 	gtk_widget_realize (win);
 	g_signal_connect(win, "destroy", quitCB, cbData);
 	gtk_window_set_default_size(mWindow, 1024, 480);
+#if GTK_CHECK_VERSION(3,8,0)
+	g_signal_connect_swapped(G_OBJECT(gtk_widget_get_frame_clock(win)), "update", G_CALLBACK(FrameUpdate), this);
+#endif
 
 	mAccelGroup = gtk_accel_group_new();
 	gtk_window_add_accel_group(mWindow, mAccelGroup);
@@ -86,6 +92,7 @@ void View::Create(GdkPixbuf *icon, GCallback buttonCB, GCallback toggleButtonCB,
 	auto menu = this->AddMenu(menubar, "_File");
 	this->AddMenuButton(menu, "_Open", "open", buttonCB, cbData);
 	this->AddMenuButton(menu, "_Close", "close", buttonCB, cbData);
+	this->AddMenuButton(menu, "_Save performance report", "saveperformance", buttonCB, cbData);
 	this->AddMenuButton(menu, "_Exit", "quit", buttonCB, cbData);
 
 	menu = this->AddMenu(menubar, "_Edit");
@@ -103,6 +110,11 @@ void View::Create(GdkPixbuf *icon, GCallback buttonCB, GCallback toggleButtonCB,
 	gtk_widget_set_name(GTK_WIDGET(menuItem), "ignoreduplicates");
 	g_signal_connect(menuItem, "toggled", toggleButtonCB, cbData);
 
+	menuItem = gtk_check_menu_item_new_with_mnemonic("Show p_erformance");
+	gtk_menu_shell_append(GTK_MENU_SHELL(menu), menuItem);
+	gtk_widget_set_name(GTK_WIDGET(menuItem), "performance");
+	g_signal_connect(menuItem, "toggled", toggleButtonCB, cbData);
+
 	menu = this->AddMenu(menubar, "_Help");
 	this->AddMenuButton(menu, "_Help", "help", buttonCB, cbData);
 	this->AddMenuButton(menu, "_About", "about", buttonCB, cbData);
@@ -142,6 +154,17 @@ void View::Create(GdkPixbuf *icon, GCallback buttonCB, GCallback toggleButtonCB,
 	gtk_widget_set_name(button, "findprev");
 	gtk_box_pack_start(GTK_BOX (statusBar), button, FALSE, FALSE, 0);
 
+	// The performance panel is above the status bar, and hidden until asked for
+	mPerformance = gtk_label_new("");
+	gtk_label_set_selectable(GTK_LABEL(mPerformance), true);
+#if GTK_CHECK_VERSION(3,0,0)
+	gtk_widget_set_halign(mPerformance, GTK_ALIGN_START);
+#else
+	gtk_misc_set_alignment(GTK_MISC(mPerformance), 0, 0);
+#endif
+	gtk_widget_set_no_show_all(mPerformance, true);
+	gtk_box_pack_end(GTK_BOX (mainbox), mPerformance, FALSE, FALSE, 0);
+
 //	GClosure *findAgain = g_cclosure_new_swap(G_CALLBACK(mainwindow_new_tab), cbData, NULL);
 //	gtk_accel_group_connect(mAccelGroup, GDK_KEY_F3, GdkModifierType(0), GTK_ACCEL_VISIBLE, findAgain);
 
@@ -196,7 +219,11 @@ void View::Create(GdkPixbuf *icon, GCallback buttonCB, GCallback toggleButtonCB,
 
 	// Create an empty tree model
 	// ==========================
-	mPattern = gtk_tree_store_new(2, G_TYPE_STRING, G_TYPE_BOOLEAN);
+	// The pattern, if it is active, and the matching lines, the selectivity and the time used by the node
+	mPattern = gtk_tree_store_new(5, G_TYPE_STRING, G_TYPE_BOOLEAN, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING);
+	// Any change of the tree means the filter has to be compiled again
+	for (auto signal : { "row-changed", "row-inserted", "row-deleted", "rows-reordered" })
+		g_signal_connect_swapped(G_OBJECT(mPattern), signal, G_CALLBACK(PatternChanged), this);
 
 	// Create the tree view
 	// ====================
@@ -220,6 +247,16 @@ void View::Create(GdkPixbuf *icon, GCallback buttonCB, GCallback toggleButtonCB,
 	gtk_tree_view_column_set_expand(column, FALSE);
 	gtk_tree_view_append_column(mTreeView, column);
 
+	// The profile of every node
+	int statColumn = 2;
+	for (auto title : { "Lines", "%", "ms" }) {
+		renderer = gtk_cell_renderer_text_new();
+		g_object_set(G_OBJECT(renderer), "xalign", 1.0, NULL);
+		column = gtk_tree_view_column_new_with_attributes(title, renderer, "text", statColumn++, NULL);
+		gtk_tree_view_column_set_expand(column, FALSE);
+		gtk_tree_view_append_column(mTreeView, column);
+	}
+
 	GtkWidget *scrollview = gtk_scrolled_window_new(NULL, NULL);
 	gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrollview), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
 	gtk_widget_set_size_request(scrollview, 150, -1);
@@ -245,28 +282,20 @@ int View::AddTab(Document *doc, gpointer cbData, GCallback dragReceived, GCallba
 	ss << nextId;
 	gtk_widget_set_name(labelWidget, ss.str().c_str());
 
-	// Create the text display window
-	GtkWidget *scrollview = gtk_scrolled_window_new( NULL, NULL );
-	doc->mScrolledView = GTK_SCROLLED_WINDOW(scrollview);
-	gtk_scrolled_window_set_policy(doc->mScrolledView, GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
-	gtk_container_set_border_width(GTK_CONTAINER(scrollview), 1);
-	auto textview = gtk_text_view_new();
+	if (mSearchJob.Active(doc))
+		mSearchJob.Restart(); // A new document where an old one was
+	// Create the text display window. It is deleted when the widget is destroyed.
+	doc->mLogView = new LogView(doc);
+	doc->mLogView->SetShowLineNumbers(mShowLineNumbers);
+	auto textview = doc->mLogView->GetTextWidget();
 	gtk_drag_dest_set(textview, GTK_DEST_DEFAULT_DROP, NULL, 0, GDK_ACTION_COPY);
 	gtk_drag_dest_add_uri_targets(textview);
 	g_signal_connect(G_OBJECT(textview), "drag-drop", G_CALLBACK(DragDrop), cbData );
 	g_signal_connect(G_OBJECT(textview), "drag-data-received", dragReceived, cbData );
 	g_signal_connect(G_OBJECT(textview), "key-press-event", textViewkeyPress, cbData );
-	doc->mTextView = GTK_TEXT_VIEW(textview);
-	gtk_text_view_set_wrap_mode(doc->mTextView, GTK_WRAP_CHAR);
-	PangoFontDescription *font = pango_font_description_from_string("Monospace Regular 8");
-#if GTK_CHECK_VERSION(3,0,0)
-	gtk_widget_override_font(textview, font);
-#else
-	gtk_widget_modify_font(textview, font);
-#endif
-	gtk_container_add(GTK_CONTAINER (scrollview), textview);
-	int page = gtk_notebook_prepend_page(GTK_NOTEBOOK(mNotebook), scrollview, labelWidget);
-	gtk_widget_show_all(scrollview);
+	GtkWidget *logview = doc->mLogView->GetWidget();
+	int page = gtk_notebook_prepend_page(GTK_NOTEBOOK(mNotebook), logview, labelWidget);
+	gtk_widget_show_all(logview);
 	LPLOG("[%d] id %d prev page %d new page %d switching %d", GetCurrentTabId(), nextId, gtk_notebook_get_current_page(GTK_NOTEBOOK(mNotebook)), page, switchTab);
 	if (switchTab)
 		gtk_notebook_set_current_page(GTK_NOTEBOOK(mNotebook), page);
@@ -309,54 +338,116 @@ void View::DimCurrentTab() {
 }
 
 GtkWidget *View::FileOpenDialog() {
-	return gtk_file_chooser_dialog_new("Open File", mWindow, GTK_FILE_CHOOSER_ACTION_OPEN,
+	GtkWidget *dialog = gtk_file_chooser_dialog_new("Open File", mWindow, GTK_FILE_CHOOSER_ACTION_OPEN,
 										"_Cancel", GTK_RESPONSE_CANCEL,
 										"_OK", GTK_RESPONSE_ACCEPT,
 										NULL);
+	gtk_file_chooser_set_select_multiple(GTK_FILE_CHOOSER(dialog), true); // Files selected together are merged
+	return dialog;
+}
+
+GtkWidget *View::FileSaveDialog(const std::string &name) {
+	GtkWidget *dialog = gtk_file_chooser_dialog_new("Save File", mWindow, GTK_FILE_CHOOSER_ACTION_SAVE,
+										"_Cancel", GTK_RESPONSE_CANCEL,
+										"_Save", GTK_RESPONSE_ACCEPT,
+										NULL);
+	gtk_file_chooser_set_do_overwrite_confirmation(GTK_FILE_CHOOSER(dialog), true);
+	gtk_file_chooser_set_current_name(GTK_FILE_CHOOSER(dialog), name.c_str());
+	return dialog;
+}
+
+void View::TogglePerformance(Document *doc) {
+	gtk_widget_set_visible(mPerformance, !gtk_widget_get_visible(mPerformance));
+	this->ShowPerformance(doc, true);
+}
+
+void View::ShowPerformance(Document *doc, bool now) {
+	if (!gtk_widget_get_visible(mPerformance))
+		return;
+	auto time = std::chrono::steady_clock::now();
+	if (!now && time - mPerformanceTime < std::chrono::milliseconds(cPerformancePeriod))
+		return;
+	mPerformanceTime = time;
+	std::string report = doc == nullptr ? "" : doc->PerformanceReport();
+	gchar *text = g_markup_escape_text(report.c_str(), -1);
+	std::string markup = std::string("<tt>") + text + "</tt>";
+	g_free(text);
+	gtk_label_set_markup(GTK_LABEL(mPerformance), markup.c_str());
 }
 
 void View::ToggleLineNumbers(Document *doc) {
 	mShowLineNumbers = !mShowLineNumbers;
-	// Remember the current scrollbar value
-	g_assert(doc->mScrolledView != nullptr);
-	auto adj = gtk_scrolled_window_get_vadjustment(doc->mScrolledView);
-	gdouble pos = gtk_adjustment_get_value(adj);
-	this->Replace(doc);
-	if (!gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(mAutoScroll)))
-		gtk_adjustment_set_value(adj, pos+0.1); // A delta is needed, or it will be a noop!
-	LPLOG("[%d] scrollbar pos %f", GetCurrentTabId(), pos);
+	// The line numbers are added when the rows are drawn, there is no need to filter again
+	g_assert(doc->mLogView != nullptr);
+	doc->mLogView->SetShowLineNumbers(mShowLineNumbers);
+	LPLOG("[%d] line numbers %d", GetCurrentTabId(), mShowLineNumbers);
 }
 
-void View::FilterString(std::stringstream &ss, Document *doc, bool restartFirstLine) {
-	const char *separator = ""; // Start empty
+void View::FilterLines(Document *doc, bool restartFirstLine) {
+	Metrics::Scope scope(doc->GetMetrics(), Metrics::Timer::Filter);
 #ifdef DEBUG
 	unsigned startLine = mFoundLines;
 #endif
-	if (mFoundLines > 0)
-		separator = "\n";
-    std::string prevLine = "";
-	// Add the lines to ss, one at a time. The last line shall not have a newline.
-	auto TestLine = [&] (const std::string &str, unsigned line) {
-		if (isShown(str, GTK_TREE_MODEL(mPattern), &mPatternRoot) == Evaluation::Nomatch)
+    LineRef prevLine = { "", 0 };
+	this->UpdateFilter();
+	if (restartFirstLine)
+		mProfile.clear();
+	LineSet shown = doc->Select(mFilter, mPool, restartFirstLine, &mProfile);
+	mProfileChanged = true;
+	if (restartFirstLine && mPool.size() > 1 && doc->GetNumLines() >= cMinParallelLines) {
+		this->FilterParallel(doc, shown);
+		return;
+	}
+	auto TestLine = [&] (const LineRef &str, unsigned line) {
+		if (!shown.Contains(line))
             return false;
         if (mIgnoreDuplicateLines) {
             if (str == prevLine)
                 return false;
             prevLine = str;
         }
-        ss << separator;
-        if (mShowLineNumbers) {
-            ss << line+1 << "\t";
-        }
-        ss << str;
-        separator = "\n";
         ++mFoundLines;
         return true;
 	};
-	LPLOG("[%d] starting line %d, total lines %d", GetCurrentTabId(), startLine, mFoundLines);
+	LPTRACE("[%d] starting line %d, total lines %d", GetCurrentTabId(), startLine, mFoundLines);
 	doc->IterateLines(TestLine, restartFirstLine);
 }
 
+// The same as FilterLines, but for a restart using all threads.
+void View::FilterParallel(Document *doc, const LineSet &shown) {
+	struct Chunk {
+		unsigned numLines;
+		LineRef firstLine;
+		LineRef prevLine;  // Last line accepted
+	};
+	unsigned numChunks = std::min(doc->GetNumLines() / (cMinParallelLines / cChunksPerThread), mPool.size() * cChunksPerThread);
+	std::vector<Chunk> chunks(numChunks, Chunk{0, { "", 0 }, { "", 0 }});
+	auto TestLine = [&] (const LineRef &str, unsigned line, unsigned c) {
+		Chunk &chunk = chunks[c];
+		// The first line of a chunk can only be compared with the line before when the chunks are merged
+		if (mIgnoreDuplicateLines && (c == 0 || chunk.numLines > 0) && str == chunk.prevLine)
+			return false;
+		chunk.prevLine = str;
+		if (chunk.numLines++ == 0)
+			chunk.firstLine = str;
+		return true;
+	};
+	LineRef prevLine = { "", 0 };
+	auto Merge = [&] (unsigned c, std::vector<unsigned> &accepted) {
+		Chunk &chunk = chunks[c];
+		if (mIgnoreDuplicateLines && !accepted.empty() && chunk.firstLine == prevLine) {
+			// The following lines were compared with this one, which is the same as comparing with 'prevLine'.
+			accepted.erase(accepted.begin());
+		}
+		if (accepted.empty())
+			return;
+		mFoundLines += accepted.size();
+		prevLine = chunk.prevLine;
+	};
+	doc->IterateLinesParallel(mPool, shown, numChunks, TestLine, Merge);
+	LPLOG("[%d] %u chunks, total lines %d", GetCurrentTabId(), numChunks, mFoundLines);
+}
+
 void View::OpenPatternForEditing() {
 	GtkTreeSelection *selection = gtk_tree_view_get_selection(mTreeView);
 	GtkTreeModel *pattern = 0;
@@ -380,64 +471,83 @@ bool View::RootPatternActive() {
 	return active;
 }
 
-View::Evaluation View::isShown(const std::string &line, GtkTreeModel *pattern, GtkTreeIter *iter) {
+void View::UpdateFilter() {
+	if (!mFilterChanged)
+		return;
+	mFilter.Clear();
+	GtkTreeIter root;
+	if (gtk_tree_model_get_iter_first(GTK_TREE_MODEL(mPattern), &root))
+		Compile(GTK_TREE_MODEL(mPattern), &root);
+	mFilterChanged = false;
+	mProfile.clear();
+	LPLOG("compiled %u nodes", mFilter.size());
+}
+
+void View::PatternChanged(View *view) {
+	if (view->mShowingProfile)
+		return; // Only the profile changed, not the filter
+	view->mFilterChanged = true;
+}
+
+void View::ShowProfile(bool now) {
+	auto time = std::chrono::steady_clock::now();
+	if (!mProfileChanged || mFilterChanged || (!now && time - mProfileTime < std::chrono::milliseconds(cPerformancePeriod)))
+		return;
+	mProfileTime = time;
+	mProfileChanged = false;
+	mShowingProfile = true;
+	GtkTreeIter root;
+	unsigned node = 0;
+	if (gtk_tree_model_get_iter_first(GTK_TREE_MODEL(mPattern), &root))
+		ShowProfile(&root, node, true);
+	mShowingProfile = false;
+}
+
+// The nodes are visited in the same order as Compile(), to find the index of every node in the filter.
+void View::ShowProfile(GtkTreeIter *iter, unsigned &node, bool compiled) {
+	GtkTreeModel *pattern = GTK_TREE_MODEL(mPattern);
 	GValue val = { 0 };
 	gtk_tree_model_get_value(pattern, iter, 1, &val);
 	bool active = g_value_get_boolean(&val);
 	g_value_unset(&val);
-	if (!active)
-		return Evaluation::Neither;
-	gtk_tree_model_get_value(pattern, iter, 0, &val);
-	Defer valFree([&val](){g_value_unset(&val);});
-	Evaluation ret = Evaluation::Neither; // Use this as default
-	const gchar *str = g_value_get_string(&val);
+	const Filter::NodeProfile *profile = nullptr;
+	if (compiled && node < mProfile.size())
+		profile = &mProfile[node];
+	if (compiled)
+		node++;
+	if (profile == nullptr || profile->lines == 0) {
+		gtk_tree_store_set(mPattern, iter, 2, "", 3, "", 4, "", -1);
+	} else {
+		char selectivity[20], ms[20];
+		snprintf(selectivity, sizeof selectivity, "%.1f", 100.0 * profile->matches / profile->lines);
+		snprintf(ms, sizeof ms, "%.1f", profile->seconds * 1000);
+		gtk_tree_store_set(mPattern, iter, 2, std::to_string(profile->matches).c_str(), 3, selectivity, 4, ms, -1);
+	}
+	// The children of a node that is not active are not in the filter
 	GtkTreeIter child;
 	bool childFound = gtk_tree_model_iter_children(pattern, &child, iter);
-	if (str == 0) {
-	} else if (strcmp(str, "|") == 0 && childFound) {
-		do {
-			auto current = isShown(line, pattern, &child);
-			if (current == Evaluation::Match) {
-				ret = Evaluation::Match;
-				break;
-			} else if (current == Evaluation::Nomatch) {
-				// At least one Nomatch found, continue looking for Match.
-				ret = Evaluation::Nomatch;
-			}
-			childFound = gtk_tree_model_iter_next(pattern, &child);
-		} while (childFound);
-	} else if (strcmp(str, "&") == 0 && childFound) {
-		do {
-			auto current = isShown(line, pattern, &child);
-			if (current == Evaluation::Nomatch) {
-				ret = Evaluation::Nomatch;
-				break;
-			} else if (current == Evaluation::Match) {
-				// At least one Match found, continue looking for Nomatch.
-				ret = Evaluation::Match;
-			}
-			childFound = gtk_tree_model_iter_next(pattern, &child);
-		} while (childFound);
-	} else if (strcmp(str, "!") == 0 && childFound) {
-		switch (isShown(line, pattern, &child)) {
-		case Evaluation::Match:
-			ret = Evaluation::Nomatch;
-			break;
-		case Evaluation::Neither:
-			ret = Evaluation::Neither;
-			break;
-		case Evaluation::Nomatch:
-			ret = Evaluation::Match;
-			break;
-		}
-	} else {
-		auto pos = line.find(str);
-		if (pos != std::string::npos)
-			ret = Evaluation::Match;
-		else
-			ret = Evaluation::Nomatch;
+	while (childFound) {
+		ShowProfile(&child, node, compiled && active);
+		childFound = gtk_tree_model_iter_next(pattern, &child);
 	}
-	return ret;
+}
+
+// Add the node and all its children to the filter.
+void View::Compile(GtkTreeModel *pattern, GtkTreeIter *iter) {
+	GValue val = { 0 };
+	gtk_tree_model_get_value(pattern, iter, 1, &val);
+	bool active = g_value_get_boolean(&val);
+	g_value_unset(&val);
+	gtk_tree_model_get_value(pattern, iter, 0, &val);
+	mFilter.Begin(g_value_get_string(&val), active);
+	g_value_unset(&val);
+	GtkTreeIter child;
+	bool childFound = active && gtk_tree_model_iter_children(pattern, &child, iter);
+	while (childFound) {
+		Compile(pattern, &child);
+		childFound = gtk_tree_model_iter_next(pattern, &child);
+	}
+	mFilter.End();
 }
 
 void View::Serialize(std::stringstream &ss) {
@@ -485,9 +595,12 @@ void View::DeSerialize(SaveFile &save) {
 // s,
 // s)
 string::size_type View::DeSerialize(const string &str, GtkTreeIter *parent, GtkTreeIter *node, unsigned level) {
-	auto opening = str.find('(');
-	auto closing = str.find(')');
-	auto comma = str.find(',');
+	// A regular expression may contain the characters used for the tree
+	auto regexEnd = Regex::End(str);
+	auto from = regexEnd == string::npos ? 0 : regexEnd;
+	auto opening = str.find('(', from);
+	auto closing = str.find(')', from);
+	auto comma = str.find(',', from);
 	auto stopper = std::min(std::min(comma, str.size()), std::min(closing, opening));
 	LPLOG("%*s'%s'", level*2, "", str.substr(0, stopper).c_str());
 	gtk_tree_store_set(mPattern, node, 0, str.substr(0, stopper).c_str(), 1, true, -1);
@@ -517,69 +630,133 @@ void View::TogglePattern(gchar *path) {
 	g_value_unset(&val);
 }
 
+// The scroll position is kept, as only the number of rows is changed
 void View::Append(Document *doc) {
-	// Remember the current scrollbar value
-	g_assert(doc->mScrolledView != nullptr);
-	auto adj = gtk_scrolled_window_get_vadjustment(doc->mScrolledView);
-	gdouble pos = gtk_adjustment_get_value(adj);
-	LPLOG("[%d] scrollbar %f", GetCurrentTabId(), pos);
-	std::stringstream ss;
-	this->FilterString(ss, doc, false);
-	GtkTextIter last;
-	g_assert(doc->mTextView != nullptr);
-	auto buffer = gtk_text_view_get_buffer(doc->mTextView);
-	gtk_text_buffer_get_end_iter(buffer, &last);
-	gtk_text_buffer_insert(buffer, &last, ss.str().c_str(), -1);
-	if (!gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(mAutoScroll)))
-		gtk_adjustment_set_value(adj, pos-0.01); // A delta is needed, or it will be a noop!
+	Metrics::Scope scope(doc->GetMetrics(), Metrics::Timer::Append);
+	g_assert(doc->mLogView != nullptr);
+	unsigned evicted = doc->Evict();
+	if (evicted > 0) {
+		mFoundLines -= evicted;
+		doc->mLogView->RemoveRows(evicted);
+		if (mSearchJob.Active(doc))
+			mSearchJob.RemoveRows(evicted);
+	}
+	this->FilterLines(doc, false);
+	doc->mLogView->Update(false);
+	this->ShowProfile(false);
 }
 
 void View::Replace(Document *doc) {
+	Metrics::Scope scope(doc->GetMetrics(), Metrics::Timer::Replace);
+	doc->Evict(); // All rows are new anyway
 	mFoundLines = 0;
-	auto adj = gtk_scrolled_window_get_vadjustment(doc->mScrolledView);
-	gdouble pos = gtk_adjustment_get_value(adj);
-	LPLOG("[%d] old position %f", GetCurrentTabId(), pos);
-	std::stringstream ss;
-	this->FilterString(ss, doc, true);
-	g_assert(doc->mTextView != nullptr);
-	gtk_text_buffer_set_text(gtk_text_view_get_buffer(doc->mTextView), ss.str().c_str(), -1);
-	gtk_adjustment_set_value(adj, pos-0.01); // A delta is needed, or it will be a noop!
+	this->FilterLines(doc, true);
+	g_assert(doc->mLogView != nullptr);
+	doc->mLogView->SetShowLineNumbers(mShowLineNumbers);
+	doc->mLogView->Update(true);
+	// The search follows the current document
+	if (mSearchJob.Active(doc))
+		mSearchJob.Restart();
+	else if (!mSearchJob.GetFinder().str().empty())
+		mSearchJob.Start(mSearchJob.GetFinder(), doc);
+	doc->mLogView->SetHighlight(mSearchJob.GetFinder());
+	this->ShowProfile(true);
+}
+
+void View::Prepend(Document *doc) {
+	LogView *view = doc->mLogView;
+	g_assert(view != nullptr);
+	// The line numbers of the shown rows have changed by the lines prepended, or lines were cut, see UpdateResult
+	unsigned lineNumber = 0;
+	if (view->GetTopRow() < view->GetNumRows())
+		doc->GetShownLine(view->GetTopRow(), &lineNumber);
+	this->Replace(doc);
+	view->ScrollToRow(doc->GetShownRow(lineNumber + doc->PrependedLines()));
 }
 
 void View::FindNext(Document *doc, std::string str, int direction) {
-	if (!mCaseSensitive)
-		std::transform(str.begin(), str.end(),str.begin(), ::tolower);
 	LPLOG("[%d] '%s'", GetCurrentTabId(), str.c_str());
-	GtkTextBuffer *buff = gtk_text_view_get_buffer(doc->mTextView);
-	int lineCount = gtk_text_buffer_get_line_count(buff);
-	GtkTextIter lineStart = { 0 };
-	gtk_text_buffer_get_iter_at_line(buff, &lineStart, doc->mLastSearchLine+direction);
-	for (int line=doc->mLastSearchLine+direction; line < lineCount && line >= 0; line += direction) {
-		GtkTextIter lineEnd; // Find end of current line. Last line is special case.
-		if (line == lineCount-1)
-			gtk_text_buffer_get_iter_at_offset(buff, &lineEnd, -1);
+	Metrics::Scope scope(doc->GetMetrics(), Metrics::Timer::Find);
+	LogView *view = doc->mLogView;
+	g_assert(view != nullptr);
+	Finder finder(str, mCaseSensitive);
+	size_t pos = 0, size = 0;
+	int line = doc->FindRow(finder, doc->mLastSearchLine+direction, direction, &pos, &size);
+	if (line >= 0)
+		ShowMatch(doc, line, pos, size);
+	auto &current = mSearchJob.GetFinder();
+	if (!mSearchJob.Active(doc) || str != current.str() || mCaseSensitive != current.CaseSensitive()) {
+		// The string wasn't typed, find all rows again
+		if (str.empty())
+			mSearchJob.Cancel();
 		else
-			gtk_text_buffer_get_iter_at_line(buff, &lineEnd, line+1);
-		std::string currentLine = gtk_text_buffer_get_text(buff, &lineStart, &lineEnd, FALSE);
-		if (!mCaseSensitive)
-			std::transform(currentLine.begin(), currentLine.end(),currentLine.begin(), ::tolower);
-		std::string::size_type pos = currentLine.find(str);
-		if (pos != std::string::npos) {
-			LPLOG("line %d", line);
-			gtk_text_view_scroll_to_iter(doc->mTextView, &lineStart, 0.0, true, 0.0, 0.0); // Scroll the found line into view
-			GtkTextIter searchStart = { 0 }, searchEnd = { 0 };
-			gtk_text_buffer_get_iter_at_line_offset(buff, &searchStart, line, pos);
-			gtk_text_buffer_get_iter_at_line_offset(buff, &searchEnd, line, pos+str.size());
-			gtk_text_buffer_select_range(buff, &searchStart, &searchEnd); // Set selection on the found pattern
-			doc->mLastSearchLine = line;
-			if (doc->mLastSearchLine >= lineCount)
-				doc->mLastSearchLine = lineCount-1;
-			if (doc->mLastSearchLine < 0)
-				doc->mLastSearchLine = -1;
-			return;
-		}
-		lineStart = lineEnd;
+			mSearchJob.Start(finder, doc);
+		view->SetHighlight(finder);
+	}
+	SetStatusText(doc);
+}
+
+void View::ShowMatch(Document *doc, int row, size_t pos, size_t size) {
+	LPLOG("line %d", row);
+	LogView *view = doc->mLogView;
+	unsigned start = view->GetPrefixSize(row) + pos;
+	view->ScrollToRow(row); // Scroll the found line into view
+	view->Select(row, start, start+size); // Set selection on the found pattern
+	doc->mLastSearchLine = row;
+}
+
+void View::StartSearch(Document *doc, const std::string &str) {
+	LPLOG("[%d] '%s'", GetCurrentTabId(), str.c_str());
+	Finder finder(str, mCaseSensitive);
+	if (str.empty())
+		mSearchJob.Cancel();
+	else
+		mSearchJob.Start(finder, doc);
+	g_assert(doc->mLogView != nullptr);
+	doc->mLogView->SetHighlight(finder);
+	mSearchJump = !str.empty();
+	SetStatusText(doc);
+}
+
+bool View::JumpToTime(Document *doc, const std::string &str) {
+	Timestamp::Time time, unit;
+	bool timeOfDay;
+	if (!doc->HasTimes() || !Timestamp::ParseUser(str, &time, &unit, &timeOfDay))
+		return false;
+	LogView *view = doc->mLogView;
+	g_assert(view != nullptr);
+	unsigned lineNumber = doc->GetFirstLine();
+	if (view->GetTopRow() < view->GetNumRows())
+		doc->GetShownLine(view->GetTopRow(), &lineNumber);
+	unsigned row = doc->GetShownRow(doc->GetLineAt(time, timeOfDay, lineNumber));
+	LPLOG("[%d] '%s' row %u", GetCurrentTabId(), str.c_str(), row);
+	mSearchJob.Cancel();
+	mSearchJump = false;
+	view->SetHighlight(Finder());
+	view->ScrollToRow(row);
+	doc->mLastSearchLine = row;
+	SetStatusText(doc);
+	return true;
+}
+
+bool View::SearchStep(Document *doc) {
+	if (!mSearchJob.Active(doc) || mSearchJob.Done())
+		return false;
+	Metrics::Scope scope(doc->GetMetrics(), Metrics::Timer::Find);
+	bool more = mSearchJob.Step(mPool);
+	auto &rows = mSearchJob.Rows();
+	if (mSearchJump && !rows.empty()) {
+		// The first row found is the first row with the string, as rows are tested in order
+		size_t pos = 0, size = 0;
+		int row = doc->FindRow(mSearchJob.GetFinder(), rows[0], 1, &pos, &size);
+		if (row >= 0)
+			ShowMatch(doc, row, pos, size);
 	}
+	if (mSearchJump && (!rows.empty() || !more))
+		mSearchJump = false;
+	if (rows.size() != mSearchShownRows || !more)
+		SetStatusText(doc);
+	return more;
 }
 
 void View::FindSetCaseSensitive() {
@@ -593,19 +770,84 @@ const std::string View::GetSearchString() const {
 void View::UpdateStatusBar(Document *doc) {
 	if (doc == nullptr) {
 		gtk_label_set_text(mStatusText, "");
+		this->ShowPerformance(doc, true);
 		return;
 	}
 	if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(mAutoScroll))) {
-		GtkTextIter lastLine;
-		g_assert(doc->mTextView != nullptr);
-		auto buffer = gtk_text_view_get_buffer(doc->mTextView);
-		gtk_text_buffer_get_end_iter(buffer, &lastLine);
-		GtkTextMark *mark = gtk_text_buffer_create_mark(buffer, NULL, &lastLine, true);
-		gtk_text_view_scroll_to_mark(doc->mTextView, mark, 0.0, true, 0.0, 1.0);
+		g_assert(doc->mLogView != nullptr);
+		doc->mLogView->ScrollToEnd();
 	}
+	SetStatusText(doc);
+}
+
+void View::UpdateRate(Document *doc) {
+	if (doc->LinesPerSecond() != mShownRate)
+		SetStatusText(doc);
+	this->ShowPerformance(doc, false);
+	this->ShowProfile(false);
+}
+
+void View::SetStatusText(Document *doc) {
+	mShownRate = doc->LinesPerSecond();
 	std::stringstream ss;
 	ss << doc->GetFileName() << "   " << doc->Date() << "                     " << mFoundLines << " (" << doc->GetNumLines() << ")";
+	if (mShownRate > 0) {
+		ss << "   " << mShownRate << " lines/s incoming";
+		if (!mRateTimer)
+			g_timeout_add_seconds(1, GSourceFunc(RateTimeout), this);
+		mRateTimer = true;
+	}
+	if (doc->HeadMissing())
+		ss << "   reading the start of the file";
+	if (doc->TimesOutOfOrder() > 0)
+		ss << "   " << doc->TimesOutOfOrder() << " lines out of time order";
+	mSearchShownRows = mSearchJob.Rows().size();
+	if (mSearchJob.Active(doc)) {
+		auto &rows = mSearchJob.Rows();
+		auto it = std::lower_bound(rows.begin(), rows.end(), unsigned(doc->mLastSearchLine));
+		const char *more = mSearchJob.Done() ? "" : "+"; // Still searching
+		if (doc->mLastSearchLine >= 0 && it != rows.end() && *it == unsigned(doc->mLastSearchLine))
+			ss << "   match " << it - rows.begin() + 1 << " of " << rows.size() << more;
+		else
+			ss << "   " << rows.size() << more << " matches";
+	}
 	gtk_label_set_text(mStatusText, ss.str().c_str());
+	this->ShowPerformance(doc, false);
+}
+
+bool View::TakeFrame() {
+	bool started = mFrameStarted;
+	mFrameStarted = false;
+	return started;
+}
+
+void View::RequestFrame() {
+	if (mFrameRequested)
+		return;
+	mFrameRequested = true;
+#if GTK_CHECK_VERSION(3,8,0)
+	gdk_frame_clock_request_phase(gtk_widget_get_frame_clock(GTK_WIDGET(mWindow)), GDK_FRAME_CLOCK_PHASE_UPDATE);
+#else
+	g_timeout_add(cFramePeriod, GSourceFunc(FrameTimeout), this);
+#endif
+}
+
+#if GTK_CHECK_VERSION(3,8,0)
+void View::FrameUpdate(View *view) {
+	view->mFrameRequested = false;
+	view->mFrameStarted = true;
+}
+#else
+gboolean View::FrameTimeout(View *view) {
+	view->mFrameRequested = false;
+	view->mFrameStarted = true;
+	return false; // Only once
+}
+#endif
+
+gboolean View::RateTimeout(View *view) {
+	view->mRateTimer = false; // Started again if the rate still isn't 0
+	return false;
 }
 
 void View::EditPattern(gchar *path, gchar *newString) {
@@ -18,9 +18,16 @@
 #include <gtk/gtk.h>
 #include <string>
 #include <sstream>
+#include <chrono>
+
+#include "Filter.h"
+#include "ThreadPool.h"
+#include "Finder.h"
+#include "SearchJob.h"
 
 class Document;
 class SaveFile;
+struct LineRef;
 
 class View
 {
@@ -30,12 +37,19 @@ public:
 	void SetWindowTitle(const std::string &);
 	void Append(Document *); // Append the new lines to the end of the view
 	void Replace(Document *); // Replace the lines in the view
+	void Prepend(Document *); // Lines were added before the first line, keep showing the same lines
 	void ToggleLineNumbers(Document *);
-	void FilterString(std::stringstream &ss, Document *doc, bool restartFirstLine);
+	void FilterLines(Document *doc, bool restartFirstLine); // Update the lines of the document that are shown
 	void About() const;
 	void Help(const std::string &message) const;
 	GtkWidget *FileOpenDialog();
+	GtkWidget *FileSaveDialog(const std::string &name);
+	void TogglePerformance(Document *); // Show or hide the panel with the performance of the document
 	void UpdateStatusBar(Document *doc);
+	void UpdateRate(Document *doc); // Update the status bar if the rate of new lines changed
+	// Appends are combined, and done at most once per frame.
+	bool TakeFrame();    // Return true if a new frame started since last time
+	void RequestFrame(); // Ask for a new frame, even if nothing has to be drawn
 	int AddTab(Document *, gpointer cbData, GCallback dragReceived, GCallback textViewkeyPress, bool switchTab = false);
 	void DimCurrentTab();
 	void CloseCurrentTab();
@@ -48,6 +62,12 @@ public:
 
 	void SetFocusFind();
 	void FindNext(Document *, std::string, int direction);
+	// Find all rows with the string in the background, and go to the first one when it is found
+	void StartSearch(Document *, const std::string &);
+	// Go to the first row at the time, or after it, with a binary search in the times of the lines. A time of day
+	// is on the day of the top row. Return false if it isn't a time, or if the lines have no time stamps.
+	bool JumpToTime(Document *, const std::string &);
+	bool SearchStep(Document *); // Continue the search a part of the rows. Return true if there is more to do.
 	void FindSetCaseSensitive();
 	const std::string GetSearchString() const;
 
@@ -71,18 +91,51 @@ private:
 	bool mCaseSensitive = false;
 	GtkAccelGroup *mAccelGroup = 0;
 	bool mIgnoreDuplicateLines = false;
+	unsigned mShownRate = 0; // Lines per second in the status bar
+	// All shown rows that contain the string searched for, as the status bar shows the number of them.
+	// New rows are searched when lines are appended.
+	SearchJob mSearchJob;
+	bool mSearchJump = false;        // Go to the first row, when it is found
+	unsigned mSearchShownRows = 0;   // Number of rows found, in the status bar
+	void ShowMatch(Document *doc, int row, size_t pos, size_t size); // Select the string in the row
+	void SetStatusText(Document *doc);
+	GtkWidget *mPerformance = 0; // Panel with the performance of the current document, if visible
+	std::chrono::steady_clock::time_point mPerformanceTime; // When the panel was updated
+	static const unsigned cPerformancePeriod = 1000;        // ms, the panel is updated at most this often
+	void ShowPerformance(Document *, bool now);
+
+	bool mFrameRequested = false;
+	bool mFrameStarted = true;
+#if GTK_CHECK_VERSION(3,8,0)
+	static void FrameUpdate(View *);
+#else
+	static const unsigned cFramePeriod = 16; // Milliseconds, there is no frame clock to follow
+	static gboolean FrameTimeout(View *);
+#endif
+	// While lines are coming in, the main loop is woken up every second, for the rate to go to 0 when they stop
+	bool mRateTimer = false;
+	static gboolean RateTimeout(View *);
 
 	GtkTreeStore *mPattern = 0;
 	GtkTreeView *mTreeView = 0;
 	GtkTreeIter mPatternRoot = { 0 };
 
-	enum class Evaluation {
-		Match,
-		Nomatch,
-		Neither,
-	};
-	// Test if a line is shown, given the specified tree.
-	Evaluation isShown(const std::string &, GtkTreeModel *pattern, GtkTreeIter *iter);
+	Filter mFilter; // Compiled from mPattern
+	bool mFilterChanged = true;
+	Filter::Profile mProfile;         // The cost of every node, since the filter was compiled or the lines replaced
+	bool mProfileChanged = false;     // The profile is not shown yet
+	bool mShowingProfile = false;     // The tree is changed, but not the patterns
+	std::chrono::steady_clock::time_point mProfileTime; // When the profile was shown
+	void ShowProfile(bool now);       // Show the profile in the tree, at most once every cPerformancePeriod if not 'now'
+	void ShowProfile(GtkTreeIter *iter, unsigned &node, bool compiled);
+	static void PatternChanged(View *);
+	void Compile(GtkTreeModel *pattern, GtkTreeIter *iter);
+	void UpdateFilter(); // Compile the filter again, if the tree was changed
+
+	ThreadPool mPool;
+	static const unsigned cMinParallelLines = 100000; // Fewer lines are filtered by the calling thread only
+	static const unsigned cChunksPerThread = 8;       // More than one, to balance the load
+	void FilterParallel(Document *doc, const LineSet &shown);
 	void Serialize(std::stringstream &ss, GtkTreeModel *pattern, GtkTreeIter *iter) const;
 	std::string::size_type DeSerialize(const std::string &, GtkTreeIter *parent, GtkTreeIter *node, unsigned level);
 
@@ -0,0 +1,212 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+// Measure the throughput of reading, filtering and searching, with synthetic logs or a real file.
+// Usage: lplog-bench [-l lines] [-r repeat] [-g output] [file]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <unistd.h>
+
+#include "LogGenerator.h"
+#include "Document.h"
+#include "Filter.h"
+#include "Finder.h"
+#include "ThreadPool.h"
+
+static unsigned sRepeat = 3;
+
+static double Time(std::function<void ()> f) {
+	auto start = std::chrono::steady_clock::now();
+	f();
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// The best of 'sRepeat' runs, where 'run' returns the time of the part that is measured
+static double Best(std::function<double ()> run) {
+	double best = 1e30;
+	for (unsigned i = 0; i < sRepeat; i++)
+		best = std::min(best, run());
+	return best;
+}
+
+static void Report(const std::string &name, double seconds, uint64_t bytes, unsigned lines) {
+	std::printf("%-36s %9.1f MB/s %12.0f lines/s\n", name.c_str(), bytes / seconds / 1e6, lines / seconds);
+}
+
+// Read a file the way the main loop does
+static void Load(Document &doc, const std::string &fileName) {
+	doc.SetUseIndex(false); // Measure reading the file, every time
+	doc.AddSourceFile(fileName);
+	while (doc.UpdateInputData() != Document::UpdateResult::NoChange || doc.Loading())
+		std::this_thread::yield();
+}
+
+static uint64_t Bytes(Document &doc) {
+	uint64_t bytes = 0;
+	doc.IterateLines([&bytes](const LineRef &line, unsigned) { bytes += line.size + 1; return true; }, true);
+	return bytes;
+}
+
+static void BenchText(unsigned numLines) {
+	struct Variant {
+		const char *name;
+		std::function<void (LogGenerator::Options &)> set;
+	};
+	Variant variants[] = {
+		{ "split ascii", [](LogGenerator::Options &) {} },
+		{ "split ascii crlf", [](LogGenerator::Options &o) { o.crlf = true; } },
+		{ "split utf-8", [](LogGenerator::Options &o) { o.utf8 = true; } },
+		{ "split utf-16", [](LogGenerator::Options &o) { o.utf8 = true; o.utf16 = true; } },
+		{ "split 10% color", [](LogGenerator::Options &o) { o.colorPercent = 10; } },
+		{ "split 100% color", [](LogGenerator::Options &o) { o.colorPercent = 100; } },
+		{ "split short lines", [](LogGenerator::Options &o) { o.minLength = 10; o.maxLength = 30; } },
+		{ "split long lines", [](LogGenerator::Options &o) { o.minLength = 500; o.maxLength = 2000; o.numLines /= 10; } },
+	};
+	for (auto &variant : variants) {
+		LogGenerator::Options options;
+		options.numLines = numLines;
+		variant.set(options);
+		std::string text = LogGenerator(options).Generate();
+		unsigned numLines = 0;
+		double t = Best([&]() {
+			Document doc;
+			double t = Time([&]() { doc.AddSourceText(&text[0], text.size()); });
+			numLines = doc.GetNumLines();
+			return t;
+		});
+		Report(variant.name, t, text.size(), numLines);
+	}
+}
+
+// Filters with 1 to 64 strings, where the strings are words of the generated lines
+static std::vector<std::pair<std::string, std::string>> Filters() {
+	auto Strings = [](unsigned first, unsigned count) {
+		std::string str;
+		for (unsigned i = first; i < first + count; i++) {
+			if (i > first)
+				str += ',';
+			str += LogGenerator::Word(i);
+			if (i >= LogGenerator::NumWords())
+				str += "=" + std::to_string(i); // Make it different
+		}
+		return str;
+	};
+	return {
+		{ "1 string", "error" },
+		{ "4 strings or", "|(" + Strings(0, 4) + ")" },
+		{ "16 strings and/or/not", "&(|(" + Strings(0, 8) + "),!(|(" + Strings(8, 8) + ")))" },
+		{ "64 strings or", "|(" + Strings(0, 64) + ")" },
+		{ "regex", "/user=9[0-9]*7$/" },
+	};
+}
+
+static void BenchFile(const std::string &fileName) {
+	double t = Best([&]() { Document doc; return Time([&]() { Load(doc, fileName); }); });
+	Document doc;
+	Load(doc, fileName);
+	uint64_t bytes = Bytes(doc);
+	unsigned numLines = doc.GetNumLines();
+	Report("read file", t, bytes, numLines);
+
+	// Searches that find nothing, which have to go through all lines
+	Finder finders[] = { Finder("zqx not found", true), Finder("ZQX NOT FOUND", false), Finder("/user=zz[0-9]+/", true) };
+	const char *names[] = { "find", "find ignoring case", "find regex" };
+	for (unsigned i = 0; i < 3; i++) {
+		size_t offset, length;
+		t = Best([&]() { return Time([&]() { doc.FindRow(finders[i], 0, 1, &offset, &length); }); });
+		Report(names[i], t, bytes, numLines);
+	}
+
+	ThreadPool pool;
+	for (auto &f : Filters()) {
+		Filter filter;
+		filter.Parse(f.second);
+		// All lines with all threads, as when the filter is changed. The lines of every string are
+		// remembered by the document, so a new document is needed every time.
+		t = Best([&]() {
+			Document fresh;
+			Load(fresh, fileName);
+			return Time([&]() { fresh.Select(filter, pool, true); });
+		});
+		Report("select " + f.first, t, bytes, numLines);
+	}
+}
+
+static void Usage() {
+	std::fprintf(stderr,
+		"Usage: lplog-bench [-l lines] [-r repeat] [-g output] [file]\n"
+		"  -l lines   Lines of the synthetic logs (default 1000000)\n"
+		"  -r repeat  Number of runs, where the best is reported (default 3)\n"
+		"  -g output  Only write a synthetic log to 'output'\n"
+		"  file       Measure reading, filtering and searching with this file instead of a synthetic log\n");
+}
+
+int main(int argc, char *argv[]) {
+	unsigned numLines = 1000000;
+	std::string fileName, output;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "-l" && i+1 < argc)
+			numLines = std::strtoul(argv[++i], nullptr, 10);
+		else if (arg == "-r" && i+1 < argc)
+			sRepeat = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+		else if (arg == "-g" && i+1 < argc)
+			output = argv[++i];
+		else if (arg[0] != '-' && fileName.empty())
+			fileName = arg;
+		else {
+			Usage();
+			return 2;
+		}
+	}
+	std::string temporary;
+	if (!output.empty() || fileName.empty()) {
+		LogGenerator::Options options;
+		options.numLines = numLines;
+		std::string text = LogGenerator(options).Generate();
+		if (output.empty()) {
+			char name[] = "/tmp/lplog-bench-XXXXXX";
+			int fd = mkstemp(name);
+			if (fd == -1) {
+				std::perror("lplog-bench");
+				return 1;
+			}
+			close(fd);
+			output = temporary = fileName = name;
+		}
+		std::FILE *fp = std::fopen(output.c_str(), "wb");
+		if (fp == nullptr || std::fwrite(text.data(), 1, text.size(), fp) != text.size()) {
+			std::perror(output.c_str());
+			return 1;
+		}
+		std::fclose(fp);
+		if (temporary.empty())
+			return 0; // Only generate
+	}
+	std::printf("%u threads, best of %u\n", ThreadPool().size(), sRepeat);
+	BenchText(numLines);
+	BenchFile(fileName);
+	if (!temporary.empty())
+		std::remove(temporary.c_str());
+	return 0;
+}
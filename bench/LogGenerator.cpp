@@ -0,0 +1,107 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include <cstdio>
+
+#include "LogGenerator.h"
+
+static const char *sWords[] = {
+	"connection", "request", "timeout", "user", "session", "started", "stopped", "failed", "retry", "cache",
+	"database", "query", "error", "warning", "disk", "memory", "thread", "socket", "config", "update",
+	"login", "logout", "token", "handler", "queue", "worker", "payload", "checksum", "latency", "buffer",
+};
+static const char *sLevels[] = { "DEBUG", "INFO", "INFO", "INFO", "WARN", "ERROR" };
+static const char *sModules[] = { "net", "db", "http", "auth", "sched", "io" };
+static const char *sUtf8Words[] = { "f\xc3\xb6rs\xc3\xb6k", "\xc3\xa5tg\xc3\xa4rd", "\xe2\x82\xac", "\xce\xbb", "\xe6\x97\xa5\xe5\xbf\x97" };
+
+const char *LogGenerator::Word(unsigned i) {
+	return sWords[i % NumWords()];
+}
+
+unsigned LogGenerator::NumWords() {
+	return sizeof sWords / sizeof sWords[0];
+}
+
+std::string LogGenerator::Generate() {
+	std::string text;
+	text.reserve(size_t(mOptions.numLines) * (mOptions.minLength + mOptions.maxLength) / 2);
+	for (unsigned i = 0; i < mOptions.numLines; i++)
+		this->AddLine(text);
+	if (mOptions.utf16)
+		return ToUtf16(text);
+	return text;
+}
+
+// A line looks like "12:34:56.789 INFO  [net] connection request retry=17 ..."
+void LogGenerator::AddLine(std::string &text) {
+	unsigned length = mOptions.minLength + Random(mOptions.maxLength - mOptions.minLength + 1);
+	size_t start = text.size();
+	char buff[60];
+	unsigned ms = Random(24*3600*1000);
+	const char *level = sLevels[Random(sizeof sLevels / sizeof sLevels[0])];
+	bool color = Random(100) < mOptions.colorPercent;
+	if (color)
+		text += "\033[3" + std::to_string(1 + Random(6)) + "m";
+	snprintf(buff, sizeof buff, "%02u:%02u:%02u.%03u %-5s [%s]", ms / 3600000, ms / 60000 % 60, ms / 1000 % 60, ms % 1000,
+		level, sModules[Random(sizeof sModules / sizeof sModules[0])]);
+	text += buff;
+	if (color)
+		text += "\033[0m";
+	while (text.size() - start < length) {
+		text += ' ';
+		switch (Random(8)) {
+		case 0:
+			text += Word(Random(NumWords()));
+			text += '=';
+			text += std::to_string(Random(100000));
+			break;
+		case 1:
+			if (mOptions.utf8) {
+				text += sUtf8Words[Random(sizeof sUtf8Words / sizeof sUtf8Words[0])];
+				break;
+			}
+			// Fall through
+		default:
+			text += Word(Random(NumWords()));
+			break;
+		}
+	}
+	text += mOptions.crlf ? "\r\n" : "\n";
+}
+
+// Only characters below 0x10000 are generated, which need no surrogate pairs
+std::string LogGenerator::ToUtf16(const std::string &text) {
+	std::string out = "\xff\xfe";
+	out.reserve(text.size() * 2 + 2);
+	for (size_t i = 0; i < text.size(); ) {
+		unsigned char c = text[i];
+		unsigned code, n;
+		if (c < 0x80) {
+			code = c;
+			n = 1;
+		} else if (c < 0xe0) {
+			code = ((c & 0x1f) << 6) | (text[i+1] & 0x3f);
+			n = 2;
+		} else {
+			code = ((c & 0x0f) << 12) | ((text[i+1] & 0x3f) << 6) | (text[i+2] & 0x3f);
+			n = 3;
+		}
+		out += char(code & 0xff);
+		out += char(code >> 8);
+		i += n;
+	}
+	return out;
+}
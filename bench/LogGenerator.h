@@ -0,0 +1,49 @@
+// Copyright 2013 Lars Pensjö
+//
+// Lplog is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 3.
+//
+// Lplog is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Lplog.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#pragma once
+
+#include <string>
+#include <random>
+
+// Deterministic synthetic log files, for measuring throughput.
+// The same options and seed always give the same content, on every platform.
+class LogGenerator
+{
+public:
+	struct Options {
+		unsigned numLines = 1000000;
+		unsigned minLength = 40;   // Characters of a line, not counting the end of line
+		unsigned maxLength = 160;
+		bool utf8 = false;         // Use some characters that are not ASCII
+		bool crlf = false;         // End lines with "\r\n" instead of "\n"
+		bool utf16 = false;        // Little endian UTF-16, with a byte order mark
+		unsigned colorPercent = 0; // Lines with ANSI color codes
+		unsigned seed = 1;
+	};
+	LogGenerator(const Options &options) : mOptions(options), mRandom(options.seed) {}
+	std::string Generate();
+	// Words used in the lines, for making filters and searches that find something
+	static const char *Word(unsigned i);
+	static unsigned NumWords();
+
+private:
+	Options mOptions;
+	std::mt19937 mRandom; // The raw output is the same everywhere, unlike the distributions
+	unsigned Random(unsigned n) { return mRandom() % n; }
+	void AddLine(std::string &);
+	static std::string ToUtf16(const std::string &);
+};
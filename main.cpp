@@ -28,6 +28,7 @@
 
 #include "Controller.h"
 #include "SaveFile.h"
+#include "Headless.h"
 #include "Debug.h"
 
 // Return the full path to the application, including the application name
@@ -46,6 +47,12 @@ static std::string GetInstallDir() {
 int main (int argc, char *argv[])
 {
 	LPLOG("Argc before %d", argc);
+	if (Headless::Requested(argc, argv)) {
+		// No window, and nothing is saved. The options are the same as for the window.
+		SaveFile saveFile("lplog", true);
+		saveFile.Read();
+		return Headless(saveFile).Run(argc, argv);
+	}
 	/* Initialize GTK+ */
 	gtk_init(&argc, &argv);
 	LPLOG("Argc after %d", argc);